@@ -10,7 +10,7 @@ using namespace std;
 
 
 // Size of one sector in bytes, the basic unit for all operations
-constexpr int SECTOR_SIZE = 8;
+constexpr int SECTOR_SIZE = 512;
 // Maximum number of devices in RAID
 constexpr int MAX_RAID_DEVICES = 16;
 // Minimum number of devices in RAID
@@ -44,6 +44,34 @@ struct TBlkDev {
 
 #endif /* __PROGTEST__ */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RAID_XOR_X86
+#include <immintrin.h>
+#endif
+
+// Stripe layouts of CDriveMetadata::m_layout, data chunks of a stripe follow its parity chunk(s) (left-symmetric)
+constexpr int LAYOUT_LEFT_SYMMETRIC = 0;
+// Number of ints of an array UUID
+constexpr int UUID_INT_CNT = 4;
+
 struct CDriveMetadata {
     CDriveMetadata() = default;
 
@@ -53,66 +81,983 @@ struct CDriveMetadata {
 
     int m_failed_drive_i = -1;
     int m_timestamp = 1;
+    // Timestamp of the session in which m_failed_drive_i failed
+    int m_degraded_timestamp = 0;
+    // Number of consecutive raid sectors stored on one drive before moving to the next drive
+    int m_chunk_sectors = 1;
+    // Number of sectors of the write journal area of each drive, 0 if there is no journal
+    int m_journal_sectors = 0;
+    // Parity drives of each stripe, 1 (RAID-5) or 2 (RAID-6) & the drive which failed after m_failed_drive_i
+    // (dual parity only, -1 if none)
+    int m_parity_cnt = 1;
+    int m_second_failed_drive_i = -1;
+    // Number of hot spare drives (the last drive indices), bits of spare drive indices holding a replaced failed
+    // drive & TBlkDev drive serving each drive index
+    int m_spare_cnt = 0;
+    int m_failed_spares = 0;
+    int m_drive_devices[MAX_RAID_DEVICES] = {};
+    // Member drives before a reshape in progress (0 if none), stripes below m_reshape_stripe are restriped already
+    // & stripe whose data has a copy in the reshape backup area while it's restriped (-1 if none)
+    int m_reshape_devices = 0;
+    int m_reshape_stripe = 0;
+    int m_reshape_backup_stripe = -1;
+    // TBlkDev drive & sector count, stripe layout & UUID of the array the superblock belongs to
+    int m_device_cnt = 0;
+    int m_sector_cnt = 0;
+    int m_layout = LAYOUT_LEFT_SYMMETRIC;
+    int m_uuid[UUID_INT_CNT] = {};
+};
+
+/// Options of a newly created RAID, stored in the metadata sector by CRaidVolume::create
+struct CRaidConfig {
+    // Number of consecutive raid sectors stored on one drive before moving to the next drive
+    int m_chunk_sectors = 1;
+    // Number of sectors reserved for the write journal on each drive, 0 disables the journal
+    // Has to hold a header sector & a whole stripe (m_chunk_sectors * (m_Devices - m_parity_cnt) sectors)
+    int m_journal_sectors = 0;
+    // Parity drives of each stripe, 1 (RAID-5, XOR parity) or 2 (RAID-6, P & Reed-Solomon Q syndrome, survives
+    // any two failed drives, needs MIN_RAID6_DEVICES drives)
+    int m_parity_cnt = 1;
+    // Number of drives at the end of TBlkDev kept as hot spares, outside of all stripes
+    // A drive failing while the RAID runs is replaced by a spare, which is rebuilt in the background
+    int m_spare_cnt = 0;
+};
+
+/// Options of a parity scrub, passed to CRaidVolume::scrub
+struct CScrubOptions {
+    // Rewrite parity of rows whose parity doesn't match their data, otherwise mismatches are only counted
+    bool m_repair = false;
+    // Ceiling of drive reads in MB/s (all drives together), 0 for unlimited
+    int m_max_mb_per_sec = 0;
+};
+
+/// Result of a parity scrub
+struct CScrubResult {
+    // Number of verified stripe rows
+    int m_checked_rows = 0;
+    // Number of rows whose parity didn't match their data & of those rewritten with matching parity
+    int m_mismatch_rows = 0;
+    int m_repaired_rows = 0;
+};
+
+// Buckets of CLatencyHistogram, bucket i counts latencies below 2^i microseconds not counted by bucket i-1
+constexpr int LATENCY_BUCKET_CNT = 32;
+
+/// Latency distribution in power of two microsecond buckets
+struct CLatencyHistogram {
+    uint64_t m_buckets[LATENCY_BUCKET_CNT] = {};
+    uint64_t m_count = 0;
+    uint64_t m_total_us = 0;
+
+    /// Returns the upper bound of the bucket holding a percentile
+    /// @param percentile in, 0-100
+    /// @return uint64_t, latency in microseconds, 0 if nothing was recorded
+    uint64_t percentile_us(double percentile) const;
+};
+
+// Counters of CRaidStats::m_drives, device calls of one drive
+constexpr int DRIVE_READS = 0;
+constexpr int DRIVE_WRITES = 1;
+constexpr int DRIVE_READ_SECTORS = 2;
+constexpr int DRIVE_WRITTEN_SECTORS = 3;
+// Calls that transferred less than all their sectors
+constexpr int DRIVE_ERRORS = 4;
+// Time spent in device calls, calls executed by a CDriveIoBackend are charged the time of their whole batch
+constexpr int DRIVE_BUSY_US = 5;
+constexpr int DRIVE_COUNTER_CNT = 6;
+
+// Counters of CRaidStats::m_paths, work of the read & write paths
+// Sectors read from their own drive
+constexpr int PATH_READ_SECTORS = 0;
+// Sectors of a failed drive reconstructed from the rest of their row & of those served by the row cache
+constexpr int PATH_RECONSTRUCTED_SECTORS = 1;
+constexpr int PATH_ROW_CACHE_HITS = 2;
+// Stripes written without reads, parity computed from the written data
+constexpr int PATH_FULL_STRIPES = 3;
+// Partial rows written by reading old data & parity (read-modify-write) or the unwritten data (reconstruct-write)
+constexpr int PATH_RMW_ROWS = 4;
+constexpr int PATH_RCW_ROWS = 5;
+// Sectors written to degraded rows: to a failed drive (parity only), with a failed parity drive (data only) or
+// with another failed data drive (its data reconstructed to update parity)
+constexpr int PATH_DEAD_DATA_SECTORS = 6;
+constexpr int PATH_DEAD_PARITY_SECTORS = 7;
+constexpr int PATH_DEGRADED_SECTORS = 8;
+constexpr int PATH_COUNTER_CNT = 9;
+
+/// I/O statistics of a RAID since start or CRaidVolume::reset_stats
+/// Parity amplification of a workload is the sum of drive sectors over the sectors requested by the caller
+struct CRaidStats {
+    // Counters of each TBlkDev drive, hot spares included
+    int m_drive_cnt = 0;
+    uint64_t m_drives[MAX_RAID_DEVICES][DRIVE_COUNTER_CNT] = {};
+    // Latency of single device calls
+    CLatencyHistogram m_drive_latency[MAX_RAID_DEVICES];
+    uint64_t m_paths[PATH_COUNTER_CNT] = {};
+    // Latency of read/write requests & the sectors they requested
+    CLatencyHistogram m_read_latency;
+    CLatencyHistogram m_write_latency;
+    uint64_t m_requested_read_sectors = 0;
+    uint64_t m_requested_write_sectors = 0;
+};
+
+class CDriveIoBackend;
+
+/// Runtime options of a started RAID, passed to CRaidVolume::start
+struct CRaidOptions {
+    // Number of stripes held by the write-back cache, 0 writes through
+    int m_write_back_stripes = 0;
+    // Executes batches of device calls instead of per drive workers issuing TBlkDev calls, nullptr if none
+    // Must serve the same drives as TBlkDev and outlive the started volume
+    CDriveIoBackend *m_io_backend = nullptr;
 };
 
 constexpr int FAILED_DRIVE_INDEX = 0;
 constexpr int TIMESTAMP_INDEX = 1;
+constexpr int MAGIC_INDEX = 2;
+constexpr int DEGRADED_TIMESTAMP_INDEX = 3;
+constexpr int CHUNK_SECTORS_INDEX = 4;
+constexpr int JOURNAL_SECTORS_INDEX = 5;
+constexpr int PARITY_CNT_INDEX = 6;
+constexpr int SECOND_FAILED_DRIVE_INDEX = 7;
+constexpr int SPARE_CNT_INDEX = 8;
+constexpr int FAILED_SPARES_INDEX = 9;
+// TBlkDev drive of each drive index, MAX_RAID_DEVICES ints
+constexpr int DRIVE_DEVICES_INDEX = 10;
+constexpr int RESHAPE_DEVICES_INDEX = DRIVE_DEVICES_INDEX + MAX_RAID_DEVICES;
+constexpr int RESHAPE_STRIPE_INDEX = RESHAPE_DEVICES_INDEX + 1;
+constexpr int RESHAPE_BACKUP_STRIPE_INDEX = RESHAPE_DEVICES_INDEX + 2;
+// Superblock format version (METADATA_VERSION), geometry & array UUID, UUID_INT_CNT ints
+constexpr int VERSION_INDEX = RESHAPE_BACKUP_STRIPE_INDEX + 1;
+constexpr int DEVICE_CNT_INDEX = VERSION_INDEX + 1;
+constexpr int SECTOR_CNT_INDEX = VERSION_INDEX + 2;
+constexpr int LAYOUT_INDEX = VERSION_INDEX + 3;
+constexpr int UUID_INDEX = VERSION_INDEX + 4;
+// Role (DRIVE_ROLE_*) of each drive index, MAX_RAID_DEVICES ints
+constexpr int DRIVE_ROLES_INDEX = UUID_INDEX + UUID_INT_CNT;
+// CRC32C of the metadata sector with a zero checksum field
+constexpr int METADATA_CRC_INDEX = DRIVE_ROLES_INDEX + MAX_RAID_DEVICES;
+// Number of metadata ints stored in the metadata sector
+constexpr int METADATA_INT_CNT = METADATA_CRC_INDEX + 1;
+
+// Version of the superblock format, superblocks of other versions aren't recognized
+constexpr int METADATA_VERSION = 2;
+
+// Roles of drive indices stored in the superblock, derived from the failed drives, spares & drive count
+// Index past the drives, member drive (in sync or failed), hot spare (usable or not used anymore)
+constexpr int DRIVE_ROLE_NONE = 0;
+constexpr int DRIVE_ROLE_ACTIVE = 1;
+constexpr int DRIVE_ROLE_FAILED = 2;
+constexpr int DRIVE_ROLE_SPARE = 3;
+constexpr int DRIVE_ROLE_FAULTY_SPARE = 4;
+
+// Minimum number of drives of a dual parity RAID, at least two of each stripe hold data
+constexpr int MIN_RAID6_DEVICES = 4;
+
+// Maximum chunk size in sectors
+constexpr int MAX_CHUNK_SECTORS = 4096;
+
+// Marks metadata sectors written by CRaidVolume
+constexpr int METADATA_MAGIC = 0x35444152;
+
+// Sectors zeroed by one device call of create()
+constexpr int CREATE_ZERO_SECTORS = 1024;
+// Maximum number of stripe rows read with one device call per drive in CRaidVolume::read
+constexpr int READ_BATCH_ROWS = 128;
+// Number of stripe rows rebuilt with one device call per drive by resync, I/O is served between batches
+constexpr int RESYNC_BATCH_ROWS = 64;
+// Number of write-intent bitmap regions, one bit of the bitmap sector each
+constexpr int BITMAP_REGION_CNT = SECTOR_SIZE * 8;
+// Maximum number of raid sectors of readv/writev extents handled with one batch of device calls
+constexpr int VECTOR_BATCH_SECTORS = 2048;
+// Largest gap of unneeded drive sectors readv reads to merge two runs of a drive into one device call
+constexpr int VECTOR_GAP_SECTORS = 8;
+// Number of stripe rows verified with one device call per drive by scrub
+constexpr int SCRUB_BATCH_ROWS = 64;
+// Number of stripe rows restriped with one device call per drive by reshape, I/O is served between batches
+constexpr int RESHAPE_BATCH_ROWS = 128;
+// Number of stripe locks, stripes with equal index modulo STRIPE_LOCK_CNT share a lock
+constexpr int STRIPE_LOCK_CNT = 256;
+// Number of threads executing requests submitted by CRaidVolume::submit_read/submit_write
+constexpr int REQUEST_WORKER_CNT = 8;
+// Number of reconstructed failed drive sectors kept by the degraded read cache
+constexpr int ROW_CACHE_ROWS = 1024;
+
+// Marks header sectors of write journal transactions
+constexpr int JOURNAL_MAGIC = 0x4c4e524a;
+constexpr int JOURNAL_MAGIC_INDEX = 0;
+constexpr int JOURNAL_SEQ_INDEX = 1;
+constexpr int JOURNAL_TAIL_SEQ_INDEX = 2;
+constexpr int JOURNAL_ENTRY_CNT_INDEX = 3;
+constexpr int JOURNAL_SECTOR_CNT_INDEX = 4;
+constexpr int JOURNAL_CRC_INDEX = 5;
+// Journal header entries (raid sector, sector count) start at this int
+constexpr int JOURNAL_ENTRIES_INDEX = 8;
+// Maximum number of entries of one journal transaction
+constexpr int JOURNAL_MAX_ENTRIES = (SECTOR_SIZE / sizeof(int) - JOURNAL_ENTRIES_INDEX) / 2;
+// Number of drives holding a copy of each journal transaction
+constexpr int JOURNAL_COPY_CNT = 2;
 
 // Stack allocated buffer macros
 #define INT_SECTOR_BUFFER(NAME) int NAME[SECTOR_SIZE/sizeof(int)]
 #define CHAR_SECTOR_BUFFER(NAME) char NAME[SECTOR_SIZE]
 
-class CRaidVolume {
+/// Multi-source xor kernels used for parity calculation
+/// The fastest kernel supported by the CPU (cpuid) which passes a self-test is selected on first use
+class CXorKernel {
 public:
-    CRaidVolume();
+    /// Kernel interface, xors src_cnt source buffers into dst in a single pass
+    /// arg1: Destination buffer, dst ^= src[0] ^ ... ^ src[src_cnt - 1]
+    /// arg2: Array of source buffer ptrs
+    /// arg3: Number of source buffers
+    /// arg4: Number of bytes to xor
+    using TXorFunc = void (*)(void *, const void *const *, int, int);
 
-    ~CRaidVolume();
+    /// Xors src_cnt source buffers into dst using the selected kernel
+    /// @param dst in/out, destination buffer
+    /// @param srcs in, source buffer ptrs
+    /// @param src_cnt in, number of source buffers
+    /// @param byte_cnt in, number of bytes to xor
+    static void xor_blocks(void *dst, const void *const *srcs, int src_cnt, int byte_cnt);
 
-    /// Initializes TBlkDev drives with metadata
-    /// @param dev TBlkDev interface
-    /// @return False if failed, true if succeeded
-    static bool create(const TBlkDev &dev);
+    /// Returns name of the selected kernel
+    /// @return const char *, kernel name
+    static const char *name();
 
-    /// 
-    /// @param dev 
-    /// @return 
-    int start(const TBlkDev &dev);
+    /// Compares kernel output with the scalar int by int xor over various sizes & source counts
+    /// @param kernel kernel to test
+    /// @return bool, kernel output matches
+    static bool self_test(TXorFunc kernel);
 
-    /// 
-    /// @return 
-    int stop();
+protected:
+    struct TKernel {
+        const char *m_name;
+        TXorFunc m_func;
+    };
 
-    /// Resynchronizes drives in case of RAID_DEGRADED
-    /// @return int, RAID status
-    int resync();
+    /// Picks the fastest supported kernel which passes self_test
+    /// @return TKernel, selected kernel
+    static TKernel select();
 
-    /// Returns current RAID status
-    /// @return int, RAID status
-    int status() const;
+    /// Returns selected kernel, selects it on first call
+    /// @return const TKernel &, selected kernel
+    static const TKernel &kernel();
 
-    /// Returns size of usable raid sectors
-    /// \return int, number of usable sectors
-    int size() const;
+    static void xor_scalar(void *dst, const void *const *srcs, int src_cnt, int byte_cnt);
+#ifdef RAID_XOR_X86
+    static void xor_sse2(void *dst, const void *const *srcs, int src_cnt, int byte_cnt);
+    static void xor_avx2(void *dst, const void *const *srcs, int src_cnt, int byte_cnt);
+    static void xor_avx512(void *dst, const void *const *srcs, int src_cnt, int byte_cnt);
+#endif
+};
 
-    /// Reads secCnt sectors to data starting from a given raid sector index (secNr)
-    /// \param secNr starting raid sector index
-    /// \param data memory to write data to
-    /// \param secCnt number of sectors to read
-    /// \return bool, operation success
-    bool read(int secNr, void *data, int secCnt);
+void CXorKernel::xor_blocks(void *dst, const void *const *srcs, const int src_cnt, const int byte_cnt) {
+    kernel().m_func(dst, srcs, src_cnt, byte_cnt);
+}
 
-    /// Writes secCnt sectors from data starting from a given raid sector index (secNr)
-    /// \param secNr starting raid sector index
-    /// \param data memory to read (write) data from
-    /// \param secCnt number of sectors to write
-    /// \return bool, operation success
-    bool write(int secNr, const void *data, int secCnt);
+const char *CXorKernel::name() {
+    return kernel().m_name;
+}
+
+bool CXorKernel::self_test(const TXorFunc kernel) {
+    constexpr int MAX_TEST_SOURCES = MAX_RAID_DEVICES;
+    constexpr int MAX_TEST_BYTES = 1024 + 3 * sizeof(int);
+
+    int sources[MAX_TEST_SOURCES][MAX_TEST_BYTES / sizeof(int)];
+    int expected[MAX_TEST_BYTES / sizeof(int)];
+    int result[MAX_TEST_BYTES / sizeof(int)];
+    const void *source_ptrs[MAX_TEST_SOURCES];
+
+    unsigned pattern = 0x9e3779b9u;
+    for (int src_i = 0; src_i < MAX_TEST_SOURCES; src_i++) {
+        source_ptrs[src_i] = sources[src_i];
+        for (int &value : sources[src_i])
+            value = static_cast<int>(pattern = pattern * 1664525u + 1013904223u);
+    }
+
+    // Odd sizes check the vector loop tails
+    for (int byte_cnt = sizeof(int); byte_cnt <= MAX_TEST_BYTES; byte_cnt += byte_cnt < 128 ? sizeof(int) : 61 * sizeof(int)) {
+        for (int src_cnt = 1; src_cnt <= MAX_TEST_SOURCES; src_cnt++) {
+            // Reference, int by int xor of each source
+            for (int i = 0; i < static_cast<int>(MAX_TEST_BYTES / sizeof(int)); i++)
+                expected[i] = result[i] = i;
+            for (int src_i = 0; src_i < src_cnt; src_i++)
+                for (int i = 0; i < static_cast<int>(byte_cnt / sizeof(int)); i++)
+                    expected[i] = expected[i] ^ sources[src_i][i];
+
+            kernel(result, source_ptrs, src_cnt, byte_cnt);
+            if (memcmp(result, expected, sizeof(expected)) != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+CXorKernel::TKernel CXorKernel::select() {
+#ifdef RAID_XOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && self_test(xor_avx512))
+        return {"avx512", xor_avx512};
+    if (__builtin_cpu_supports("avx2") && self_test(xor_avx2))
+        return {"avx2", xor_avx2};
+    if (__builtin_cpu_supports("sse2") && self_test(xor_sse2))
+        return {"sse2", xor_sse2};
+#endif
+    return {"scalar", xor_scalar};
+}
+
+const CXorKernel::TKernel &CXorKernel::kernel() {
+    static const TKernel selected = select();
+    return selected;
+}
+
+void CXorKernel::xor_scalar(void *dst, const void *const *srcs, const int src_cnt, const int byte_cnt) {
+    auto out = static_cast<char *>(dst);
+    int byte_i = 0;
+
+    // 8 byte words, memcpy keeps unaligned buffers safe
+    for (; byte_i + static_cast<int>(sizeof(uint64_t)) <= byte_cnt; byte_i += sizeof(uint64_t)) {
+        uint64_t acc, next;
+        memcpy(&acc, out + byte_i, sizeof(acc));
+        for (int src_i = 0; src_i < src_cnt; src_i++) {
+            memcpy(&next, static_cast<const char *>(srcs[src_i]) + byte_i, sizeof(next));
+            acc ^= next;
+        }
+        memcpy(out + byte_i, &acc, sizeof(acc));
+    }
+
+    // Remaining bytes
+    for (; byte_i < byte_cnt; byte_i++)
+        for (int src_i = 0; src_i < src_cnt; src_i++)
+            out[byte_i] = static_cast<char>(out[byte_i] ^ static_cast<const char *>(srcs[src_i])[byte_i]);
+}
+
+#ifdef RAID_XOR_X86
+__attribute__((target("sse2")))
+void CXorKernel::xor_sse2(void *dst, const void *const *srcs, const int src_cnt, const int byte_cnt) {
+    auto out = static_cast<char *>(dst);
+    int byte_i = 0;
+
+    // 4 vectors per iteration, every source is read exactly once
+    for (; byte_i + 4 * 16 <= byte_cnt; byte_i += 4 * 16) {
+        __m128i acc0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out + byte_i));
+        __m128i acc1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out + byte_i + 16));
+        __m128i acc2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out + byte_i + 32));
+        __m128i acc3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out + byte_i + 48));
+        for (int src_i = 0; src_i < src_cnt; src_i++) {
+            auto in = static_cast<const char *>(srcs[src_i]) + byte_i;
+            acc0 = _mm_xor_si128(acc0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(in)));
+            acc1 = _mm_xor_si128(acc1, _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16)));
+            acc2 = _mm_xor_si128(acc2, _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 32)));
+            acc3 = _mm_xor_si128(acc3, _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 48)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + byte_i), acc0);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + byte_i + 16), acc1);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + byte_i + 32), acc2);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + byte_i + 48), acc3);
+    }
+
+    for (; byte_i + 16 <= byte_cnt; byte_i += 16) {
+        __m128i acc = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out + byte_i));
+        for (int src_i = 0; src_i < src_cnt; src_i++) {
+            auto in = static_cast<const char *>(srcs[src_i]) + byte_i;
+            acc = _mm_xor_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i *>(in)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + byte_i), acc);
+    }
+
+    // Remaining bytes
+    const void *tail_srcs[MAX_RAID_DEVICES];
+    for (int tail_i = 0; byte_i < byte_cnt && tail_i < src_cnt; tail_i += MAX_RAID_DEVICES) {
+        const int tail_cnt = min(MAX_RAID_DEVICES, src_cnt - tail_i);
+        for (int src_i = 0; src_i < tail_cnt; src_i++)
+            tail_srcs[src_i] = static_cast<const char *>(srcs[tail_i + src_i]) + byte_i;
+        xor_scalar(out + byte_i, tail_srcs, tail_cnt, byte_cnt - byte_i);
+    }
+}
+
+__attribute__((target("avx2")))
+void CXorKernel::xor_avx2(void *dst, const void *const *srcs, const int src_cnt, const int byte_cnt) {
+    auto out = static_cast<char *>(dst);
+    int byte_i = 0;
+
+    // 4 vectors per iteration, every source is read exactly once
+    for (; byte_i + 4 * 32 <= byte_cnt; byte_i += 4 * 32) {
+        __m256i acc0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(out + byte_i));
+        __m256i acc1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(out + byte_i + 32));
+        __m256i acc2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(out + byte_i + 64));
+        __m256i acc3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(out + byte_i + 96));
+        for (int src_i = 0; src_i < src_cnt; src_i++) {
+            auto in = static_cast<const char *>(srcs[src_i]) + byte_i;
+            acc0 = _mm256_xor_si256(acc0, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in)));
+            acc1 = _mm256_xor_si256(acc1, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 32)));
+            acc2 = _mm256_xor_si256(acc2, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 64)));
+            acc3 = _mm256_xor_si256(acc3, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 96)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + byte_i), acc0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + byte_i + 32), acc1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + byte_i + 64), acc2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + byte_i + 96), acc3);
+    }
+
+    for (; byte_i + 32 <= byte_cnt; byte_i += 32) {
+        __m256i acc = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(out + byte_i));
+        for (int src_i = 0; src_i < src_cnt; src_i++) {
+            auto in = static_cast<const char *>(srcs[src_i]) + byte_i;
+            acc = _mm256_xor_si256(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in)));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + byte_i), acc);
+    }
+
+    // Remaining bytes
+    const void *tail_srcs[MAX_RAID_DEVICES];
+    for (int tail_i = 0; byte_i < byte_cnt && tail_i < src_cnt; tail_i += MAX_RAID_DEVICES) {
+        const int tail_cnt = min(MAX_RAID_DEVICES, src_cnt - tail_i);
+        for (int src_i = 0; src_i < tail_cnt; src_i++)
+            tail_srcs[src_i] = static_cast<const char *>(srcs[tail_i + src_i]) + byte_i;
+        xor_scalar(out + byte_i, tail_srcs, tail_cnt, byte_cnt - byte_i);
+    }
+}
+
+__attribute__((target("avx512f")))
+void CXorKernel::xor_avx512(void *dst, const void *const *srcs, const int src_cnt, const int byte_cnt) {
+    auto out = static_cast<char *>(dst);
+    int byte_i = 0;
+
+    // 4 vectors per iteration, every source is read exactly once
+    for (; byte_i + 4 * 64 <= byte_cnt; byte_i += 4 * 64) {
+        __m512i acc0 = _mm512_loadu_si512(out + byte_i);
+        __m512i acc1 = _mm512_loadu_si512(out + byte_i + 64);
+        __m512i acc2 = _mm512_loadu_si512(out + byte_i + 128);
+        __m512i acc3 = _mm512_loadu_si512(out + byte_i + 192);
+        for (int src_i = 0; src_i < src_cnt; src_i++) {
+            auto in = static_cast<const char *>(srcs[src_i]) + byte_i;
+            acc0 = _mm512_xor_si512(acc0, _mm512_loadu_si512(in));
+            acc1 = _mm512_xor_si512(acc1, _mm512_loadu_si512(in + 64));
+            acc2 = _mm512_xor_si512(acc2, _mm512_loadu_si512(in + 128));
+            acc3 = _mm512_xor_si512(acc3, _mm512_loadu_si512(in + 192));
+        }
+        _mm512_storeu_si512(out + byte_i, acc0);
+        _mm512_storeu_si512(out + byte_i + 64, acc1);
+        _mm512_storeu_si512(out + byte_i + 128, acc2);
+        _mm512_storeu_si512(out + byte_i + 192, acc3);
+    }
+
+    for (; byte_i + 64 <= byte_cnt; byte_i += 64) {
+        __m512i acc = _mm512_loadu_si512(out + byte_i);
+        for (int src_i = 0; src_i < src_cnt; src_i++)
+            acc = _mm512_xor_si512(acc, _mm512_loadu_si512(static_cast<const char *>(srcs[src_i]) + byte_i));
+        _mm512_storeu_si512(out + byte_i, acc);
+    }
+
+    // Remaining bytes
+    const void *tail_srcs[MAX_RAID_DEVICES];
+    for (int tail_i = 0; byte_i < byte_cnt && tail_i < src_cnt; tail_i += MAX_RAID_DEVICES) {
+        const int tail_cnt = min(MAX_RAID_DEVICES, src_cnt - tail_i);
+        for (int src_i = 0; src_i < tail_cnt; src_i++)
+            tail_srcs[src_i] = static_cast<const char *>(srcs[tail_i + src_i]) + byte_i;
+        xor_scalar(out + byte_i, tail_srcs, tail_cnt, byte_cnt - byte_i);
+    }
+}
+#endif /* RAID_XOR_X86 */
+
+/// GF(2^8) kernels of the RAID-6 Q syndrome, field polynomial x^8 + x^4 + x^3 + x^2 + 1 (0x11d), generator g = 2
+/// Q of a stripe row is the sum of g^chunk_i * D[chunk_i] over its data chunks, P is their xor. Multiplication by
+/// a constant looks up the low & high nibble of each byte in 16 byte tables (PSHUFB on x86). The fastest kernel
+/// supported by the CPU (cpuid) which passes a self-test is selected on first use.
+class CGfKernel {
+public:
+    /// Kernel interface, calculates P & Q of data blocks
+    /// arg1: P destination buffer
+    /// arg2: Q destination buffer
+    /// arg3: Array of data block ptrs, ordered by chunk index
+    /// arg4: Number of data blocks
+    /// arg5: Number of bytes of each block
+    using TSyndromeFunc = void (*)(void *, void *, const void *const *, int, int);
+
+    /// Kernel interface, multiplies a buffer by a constant & xors the product into another buffer
+    /// arg1: Destination buffer, dst ^= coef * src
+    /// arg2: Source buffer
+    /// arg3: Constant
+    /// arg4: Number of bytes
+    using TMulXorFunc = void (*)(void *, const void *, uint8_t, int);
+
+    /// Calculates P & Q of data blocks using the selected kernel
+    /// @param p out, xor of the data blocks
+    /// @param q out, sum of g^data_i * data[data_i]
+    /// @param data in, data block ptrs ordered by chunk index
+    /// @param data_cnt in, number of data blocks (at least one)
+    /// @param byte_cnt in, number of bytes of each block
+    static void gen_syndrome(void *p, void *q, const void *const *data, int data_cnt, int byte_cnt);
+
+    /// Xors coef * src into dst using the selected kernel
+    /// @param dst in/out, destination buffer
+    /// @param src in, source buffer
+    /// @param coef in, constant
+    /// @param byte_cnt in, number of bytes
+    static void mul_xor(void *dst, const void *src, uint8_t coef, int byte_cnt);
+
+    /// Reconstructs one or two lost blocks of a stripe row from the others
+    /// @param blocks in/out, data block ptrs ordered by chunk index followed by P & Q, lost blocks are overwritten
+    /// @param data_cnt in, number of data blocks
+    /// @param lost_a in, index of a lost block
+    /// @param lost_b in, index of the other lost block, -1 if only one is lost
+    /// @param byte_cnt in, number of bytes of each block
+    static void recover(void *const *blocks, int data_cnt, int lost_a, int lost_b, int byte_cnt);
+
+    /// Multiplies two field elements
+    static uint8_t mul(uint8_t a, uint8_t b);
+
+    /// Returns g^exponent, exponent may be negative
+    static uint8_t pow2(int exponent);
+
+    /// Returns the multiplicative inverse of a non-zero element
+    static uint8_t inverse(uint8_t a);
+
+    /// Returns name of the selected kernel
+    /// @return const char *, kernel name
+    static const char *name();
+
+    /// Compares kernel output with byte by byte log/exp table multiplication over various sizes & block counts
+    /// @param syndrome syndrome kernel to test
+    /// @param mul_xor multiplication kernel to test
+    /// @return bool, kernel output matches
+    static bool self_test(TSyndromeFunc syndrome, TMulXorFunc mul_xor);
 
 protected:
-    /// Checks tblkdev validity
-    /// @param dev tblkdev instance
-    /// @return bool, validity of dev
-    static bool validate_t_blk_dev(const TBlkDev &dev);
+    struct TKernel {
+        const char *m_name;
+        TSyndromeFunc m_syndrome;
+        TMulXorFunc m_mul_xor;
+    };
+
+    /// Log/exp tables & nibble product tables of every constant
+    struct CTables {
+        CTables();
+
+        uint8_t m_log[256];
+        // Doubled, so a sum of two logarithms needs no modulo
+        uint8_t m_exp[510];
+        // coef * nibble & coef * (nibble << 4)
+        uint8_t m_mul_lo[256][16];
+        uint8_t m_mul_hi[256][16];
+    };
+
+    /// Returns the tables, built on first call
+    /// @return const CTables &, tables
+    static const CTables &tables();
+
+    /// Picks the fastest supported kernel which passes self_test
+    /// @return TKernel, selected kernel
+    static TKernel select();
+
+    /// Returns selected kernel, selects it on first call
+    /// @return const TKernel &, selected kernel
+    static const TKernel &kernel();
+
+    /// Multiplies each byte of a word by g
+    static uint64_t mul2_bytes(uint64_t value);
+
+    static void syndrome_scalar(void *p, void *q, const void *const *data, int data_cnt, int byte_cnt);
+    static void mul_xor_scalar(void *dst, const void *src, uint8_t coef, int byte_cnt);
+#ifdef RAID_XOR_X86
+    static void syndrome_ssse3(void *p, void *q, const void *const *data, int data_cnt, int byte_cnt);
+    static void mul_xor_ssse3(void *dst, const void *src, uint8_t coef, int byte_cnt);
+    static void syndrome_avx2(void *p, void *q, const void *const *data, int data_cnt, int byte_cnt);
+    static void mul_xor_avx2(void *dst, const void *src, uint8_t coef, int byte_cnt);
+#endif
+};
+
+CGfKernel::CTables::CTables() {
+    uint8_t value = 1;
+    for (int power = 0; power < 255; power++) {
+        m_exp[power] = m_exp[power + 255] = value;
+        m_log[value] = static_cast<uint8_t>(power);
+        value = static_cast<uint8_t>((value << 1) ^ (value & 0x80 ? 0x1d : 0));
+    }
+    m_log[0] = 0;
+
+    // Tables aren't published yet, products use the logarithms directly
+    const auto product = [this](const int a, const int b) {
+        return a == 0 || b == 0 ? static_cast<uint8_t>(0) : m_exp[m_log[a] + m_log[b]];
+    };
+    for (int coef = 0; coef < 256; coef++) {
+        for (int nibble = 0; nibble < 16; nibble++) {
+            m_mul_lo[coef][nibble] = product(coef, nibble);
+            m_mul_hi[coef][nibble] = product(coef, nibble << 4);
+        }
+    }
+}
+
+const CGfKernel::CTables &CGfKernel::tables() {
+    static const CTables built;
+    return built;
+}
+
+void CGfKernel::gen_syndrome(void *p, void *q, const void *const *data, const int data_cnt, const int byte_cnt) {
+    kernel().m_syndrome(p, q, data, data_cnt, byte_cnt);
+}
+
+void CGfKernel::mul_xor(void *dst, const void *src, const uint8_t coef, const int byte_cnt) {
+    kernel().m_mul_xor(dst, src, coef, byte_cnt);
+}
+
+void CGfKernel::recover(void *const *blocks, const int data_cnt, int lost_a, int lost_b, const int byte_cnt) {
+    const int p_i = data_cnt;
+    const int q_i = data_cnt + 1;
+    if (lost_b >= 0 && lost_b < lost_a)
+        swap(lost_a, lost_b);
+    // Syndromes not kept go to scratch buffers, a single lost data block or P needs none
+    vector<uint8_t> scratch;
+    if (lost_b >= 0 || lost_a == q_i)
+        scratch.resize(2 * static_cast<size_t>(byte_cnt));
+    uint8_t *scratch_p = scratch.data();
+    uint8_t *scratch_q = scratch.empty() ? nullptr : scratch.data() + byte_cnt;
+
+    // Only Q is lost, it's calculated from the data
+    if (lost_a == q_i) {
+        gen_syndrome(scratch_p, blocks[q_i], blocks, data_cnt, byte_cnt);
+        return;
+    }
+
+    // A data block or P, the xor of all other data blocks and P, then Q if lost as well
+    if (lost_b < 0 || lost_b == q_i) {
+        const void *sources[MAX_RAID_DEVICES];
+        int source_cnt = 0;
+        for (int block_i = 0; block_i <= p_i; block_i++)
+            if (block_i != lost_a)
+                sources[source_cnt++] = blocks[block_i];
+        memset(blocks[lost_a], 0, byte_cnt);
+        CXorKernel::xor_blocks(blocks[lost_a], sources, source_cnt, byte_cnt);
+        if (lost_b == q_i)
+            gen_syndrome(scratch_p, blocks[q_i], blocks, data_cnt, byte_cnt);
+        return;
+    }
+
+    // Syndromes of the remaining data (lost data blocks zeroed) xored with P & Q leave only the lost data
+    memset(blocks[lost_a], 0, byte_cnt);
+    if (lost_b != p_i)
+        memset(blocks[lost_b], 0, byte_cnt);
+    gen_syndrome(scratch_p, scratch_q, blocks, data_cnt, byte_cnt);
+    const void *q_block = blocks[q_i];
+    CXorKernel::xor_blocks(scratch_q, &q_block, 1, byte_cnt);
+
+    // A data block & P, Q leaves g^x * D[x]
+    if (lost_b == p_i) {
+        mul_xor(blocks[lost_a], scratch_q, pow2(-lost_a), byte_cnt);
+        memcpy(blocks[p_i], scratch_p, byte_cnt);
+        const void *data_block = blocks[lost_a];
+        CXorKernel::xor_blocks(blocks[p_i], &data_block, 1, byte_cnt);
+        return;
+    }
+
+    // Two data blocks, P leaves D[x] + D[y] & Q leaves g^x * D[x] + g^y * D[y]
+    // D[x] = (g^(y-x) * P + g^-x * Q) / (g^(y-x) + 1), D[y] = P + D[x]
+    const void *p_block = blocks[p_i];
+    CXorKernel::xor_blocks(scratch_p, &p_block, 1, byte_cnt);
+    const uint8_t denominator = inverse(pow2(lost_b - lost_a) ^ 1);
+    mul_xor(blocks[lost_a], scratch_p, mul(pow2(lost_b - lost_a), denominator), byte_cnt);
+    mul_xor(blocks[lost_a], scratch_q, mul(pow2(-lost_a), denominator), byte_cnt);
+    memcpy(blocks[lost_b], scratch_p, byte_cnt);
+    const void *data_block = blocks[lost_a];
+    CXorKernel::xor_blocks(blocks[lost_b], &data_block, 1, byte_cnt);
+}
+
+uint8_t CGfKernel::mul(const uint8_t a, const uint8_t b) {
+    if (a == 0 || b == 0)
+        return 0;
+    const CTables &table = tables();
+    return table.m_exp[table.m_log[a] + table.m_log[b]];
+}
+
+uint8_t CGfKernel::pow2(const int exponent) {
+    return tables().m_exp[(exponent % 255 + 255) % 255];
+}
+
+uint8_t CGfKernel::inverse(const uint8_t a) {
+    const CTables &table = tables();
+    return table.m_exp[(255 - table.m_log[a]) % 255];
+}
+
+const char *CGfKernel::name() {
+    return kernel().m_name;
+}
+
+bool CGfKernel::self_test(const TSyndromeFunc syndrome, const TMulXorFunc mul_xor) {
+    constexpr int MAX_TEST_BLOCKS = MAX_RAID_DEVICES - 2;
+    constexpr int MAX_TEST_BYTES = 1024 + 7;
+
+    uint8_t blocks[MAX_TEST_BLOCKS][MAX_TEST_BYTES];
+    uint8_t expected_p[MAX_TEST_BYTES];
+    uint8_t expected_q[MAX_TEST_BYTES];
+    uint8_t result_p[MAX_TEST_BYTES];
+    uint8_t result_q[MAX_TEST_BYTES];
+    const void *block_ptrs[MAX_TEST_BLOCKS];
+
+    unsigned pattern = 0x9e3779b9u;
+    for (int block_i = 0; block_i < MAX_TEST_BLOCKS; block_i++) {
+        block_ptrs[block_i] = blocks[block_i];
+        for (uint8_t &value : blocks[block_i])
+            value = static_cast<uint8_t>((pattern = pattern * 1664525u + 1013904223u) >> 24);
+    }
+
+    // Odd sizes check the vector loop tails
+    for (int byte_cnt = 1; byte_cnt <= MAX_TEST_BYTES; byte_cnt += byte_cnt < 80 ? 1 : 97) {
+        // Reference, byte by byte sum of g^block_i * block
+        for (int block_cnt = 1; block_cnt <= MAX_TEST_BLOCKS; block_cnt++) {
+            for (int byte_i = 0; byte_i < byte_cnt; byte_i++) {
+                expected_p[byte_i] = expected_q[byte_i] = 0;
+                for (int block_i = 0; block_i < block_cnt; block_i++) {
+                    expected_p[byte_i] ^= blocks[block_i][byte_i];
+                    expected_q[byte_i] ^= mul(pow2(block_i), blocks[block_i][byte_i]);
+                }
+            }
+            syndrome(result_p, result_q, block_ptrs, block_cnt, byte_cnt);
+            if (memcmp(result_p, expected_p, byte_cnt) != 0 || memcmp(result_q, expected_q, byte_cnt) != 0)
+                return false;
+        }
+
+        for (int coef = 0; coef < 256; coef += 17) {
+            for (int byte_i = 0; byte_i < byte_cnt; byte_i++) {
+                result_p[byte_i] = expected_p[byte_i] = blocks[1][byte_i];
+                expected_p[byte_i] ^= mul(static_cast<uint8_t>(coef), blocks[0][byte_i]);
+            }
+            mul_xor(result_p, blocks[0], static_cast<uint8_t>(coef), byte_cnt);
+            if (memcmp(result_p, expected_p, byte_cnt) != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+CGfKernel::TKernel CGfKernel::select() {
+#ifdef RAID_XOR_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && self_test(syndrome_avx2, mul_xor_avx2))
+        return {"avx2", syndrome_avx2, mul_xor_avx2};
+    if (__builtin_cpu_supports("ssse3") && self_test(syndrome_ssse3, mul_xor_ssse3))
+        return {"ssse3", syndrome_ssse3, mul_xor_ssse3};
+#endif
+    return {"scalar", syndrome_scalar, mul_xor_scalar};
+}
+
+const CGfKernel::TKernel &CGfKernel::kernel() {
+    static const TKernel selected = select();
+    return selected;
+}
+
+uint64_t CGfKernel::mul2_bytes(const uint64_t value) {
+    // Shift each byte left, bytes whose high bit was shifted out are reduced by the polynomial
+    const uint64_t overflow = (value & 0x8080808080808080ull) >> 7;
+    return ((value << 1) & 0xfefefefefefefefeull) ^ (overflow * 0x1d);
+}
+
+void CGfKernel::syndrome_scalar(void *p, void *q, const void *const *data, const int data_cnt, const int byte_cnt) {
+    auto p_out = static_cast<char *>(p);
+    auto q_out = static_cast<char *>(q);
+    int byte_i = 0;
+
+    // Horner's scheme from the last block, Q = (... (D[n-1] * g + D[n-2]) * g ...) + D[0]
+    for (; byte_i + static_cast<int>(sizeof(uint64_t)) <= byte_cnt; byte_i += sizeof(uint64_t)) {
+        uint64_t p_acc, q_acc, next;
+        memcpy(&p_acc, static_cast<const char *>(data[data_cnt - 1]) + byte_i, sizeof(p_acc));
+        q_acc = p_acc;
+        for (int data_i = data_cnt - 2; data_i >= 0; data_i--) {
+            memcpy(&next, static_cast<const char *>(data[data_i]) + byte_i, sizeof(next));
+            p_acc ^= next;
+            q_acc = mul2_bytes(q_acc) ^ next;
+        }
+        memcpy(p_out + byte_i, &p_acc, sizeof(p_acc));
+        memcpy(q_out + byte_i, &q_acc, sizeof(q_acc));
+    }
+
+    // Remaining bytes
+    for (; byte_i < byte_cnt; byte_i++) {
+        uint8_t p_acc = static_cast<const uint8_t *>(data[data_cnt - 1])[byte_i];
+        uint8_t q_acc = p_acc;
+        for (int data_i = data_cnt - 2; data_i >= 0; data_i--) {
+            const uint8_t next = static_cast<const uint8_t *>(data[data_i])[byte_i];
+            p_acc ^= next;
+            q_acc = static_cast<uint8_t>(mul2_bytes(q_acc) ^ next);
+        }
+        p_out[byte_i] = static_cast<char>(p_acc);
+        q_out[byte_i] = static_cast<char>(q_acc);
+    }
+}
+
+void CGfKernel::mul_xor_scalar(void *dst, const void *src, const uint8_t coef, const int byte_cnt) {
+    auto out = static_cast<uint8_t *>(dst);
+    auto in = static_cast<const uint8_t *>(src);
+    const uint8_t *mul_lo = tables().m_mul_lo[coef];
+    const uint8_t *mul_hi = tables().m_mul_hi[coef];
+    for (int byte_i = 0; byte_i < byte_cnt; byte_i++)
+        out[byte_i] ^= mul_lo[in[byte_i] & 0x0f] ^ mul_hi[in[byte_i] >> 4];
+}
+
+#ifdef RAID_XOR_X86
+__attribute__((target("ssse3")))
+void CGfKernel::syndrome_ssse3(void *p, void *q, const void *const *data, const int data_cnt, const int byte_cnt) {
+    auto p_out = static_cast<char *>(p);
+    auto q_out = static_cast<char *>(q);
+    const __m128i poly = _mm_set1_epi8(0x1d);
+    const __m128i zero = _mm_setzero_si128();
+    int byte_i = 0;
+
+    // 2 vectors per iteration, multiplication by g doubles each byte & reduces bytes with the sign bit set
+    for (; byte_i + 2 * 16 <= byte_cnt; byte_i += 2 * 16) {
+        auto last = static_cast<const char *>(data[data_cnt - 1]) + byte_i;
+        __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(last));
+        __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(last + 16));
+        __m128i q0 = p0;
+        __m128i q1 = p1;
+        for (int data_i = data_cnt - 2; data_i >= 0; data_i--) {
+            auto in = static_cast<const char *>(data[data_i]) + byte_i;
+            const __m128i next0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+            const __m128i next1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 16));
+            p0 = _mm_xor_si128(p0, next0);
+            p1 = _mm_xor_si128(p1, next1);
+            const __m128i reduce0 = _mm_and_si128(_mm_cmpgt_epi8(zero, q0), poly);
+            const __m128i reduce1 = _mm_and_si128(_mm_cmpgt_epi8(zero, q1), poly);
+            q0 = _mm_xor_si128(_mm_xor_si128(_mm_add_epi8(q0, q0), reduce0), next0);
+            q1 = _mm_xor_si128(_mm_xor_si128(_mm_add_epi8(q1, q1), reduce1), next1);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p_out + byte_i), p0);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(p_out + byte_i + 16), p1);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(q_out + byte_i), q0);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(q_out + byte_i + 16), q1);
+    }
+
+    // Remaining bytes
+    const void *tail_data[MAX_RAID_DEVICES];
+    for (int data_i = 0; byte_i < byte_cnt && data_i < data_cnt; data_i++)
+        tail_data[data_i] = static_cast<const char *>(data[data_i]) + byte_i;
+    if (byte_i < byte_cnt)
+        syndrome_scalar(p_out + byte_i, q_out + byte_i, tail_data, data_cnt, byte_cnt - byte_i);
+}
+
+__attribute__((target("ssse3")))
+void CGfKernel::mul_xor_ssse3(void *dst, const void *src, const uint8_t coef, const int byte_cnt) {
+    auto out = static_cast<char *>(dst);
+    auto in = static_cast<const char *>(src);
+    const __m128i mul_lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables().m_mul_lo[coef]));
+    const __m128i mul_hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables().m_mul_hi[coef]));
+    const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+    int byte_i = 0;
+
+    // Product of each byte is the xor of the products of its nibbles, looked up with PSHUFB
+    for (; byte_i + 16 <= byte_cnt; byte_i += 16) {
+        const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + byte_i));
+        const __m128i lo = _mm_and_si128(value, nibble_mask);
+        const __m128i hi = _mm_and_si128(_mm_srli_epi16(value, 4), nibble_mask);
+        const __m128i product = _mm_xor_si128(_mm_shuffle_epi8(mul_lo, lo), _mm_shuffle_epi8(mul_hi, hi));
+        __m128i acc = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out + byte_i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + byte_i), _mm_xor_si128(acc, product));
+    }
+
+    // Remaining bytes
+    mul_xor_scalar(out + byte_i, in + byte_i, coef, byte_cnt - byte_i);
+}
+
+__attribute__((target("avx2")))
+void CGfKernel::syndrome_avx2(void *p, void *q, const void *const *data, const int data_cnt, const int byte_cnt) {
+    auto p_out = static_cast<char *>(p);
+    auto q_out = static_cast<char *>(q);
+    const __m256i poly = _mm256_set1_epi8(0x1d);
+    const __m256i zero = _mm256_setzero_si256();
+    int byte_i = 0;
+
+    // 2 vectors per iteration, multiplication by g doubles each byte & reduces bytes with the sign bit set
+    for (; byte_i + 2 * 32 <= byte_cnt; byte_i += 2 * 32) {
+        auto last = static_cast<const char *>(data[data_cnt - 1]) + byte_i;
+        __m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(last));
+        __m256i p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(last + 32));
+        __m256i q0 = p0;
+        __m256i q1 = p1;
+        for (int data_i = data_cnt - 2; data_i >= 0; data_i--) {
+            auto in = static_cast<const char *>(data[data_i]) + byte_i;
+            const __m256i next0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in));
+            const __m256i next1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + 32));
+            p0 = _mm256_xor_si256(p0, next0);
+            p1 = _mm256_xor_si256(p1, next1);
+            const __m256i reduce0 = _mm256_and_si256(_mm256_cmpgt_epi8(zero, q0), poly);
+            const __m256i reduce1 = _mm256_and_si256(_mm256_cmpgt_epi8(zero, q1), poly);
+            q0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_add_epi8(q0, q0), reduce0), next0);
+            q1 = _mm256_xor_si256(_mm256_xor_si256(_mm256_add_epi8(q1, q1), reduce1), next1);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p_out + byte_i), p0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p_out + byte_i + 32), p1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(q_out + byte_i), q0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(q_out + byte_i + 32), q1);
+    }
+
+    // Remaining bytes
+    const void *tail_data[MAX_RAID_DEVICES];
+    for (int data_i = 0; byte_i < byte_cnt && data_i < data_cnt; data_i++)
+        tail_data[data_i] = static_cast<const char *>(data[data_i]) + byte_i;
+    if (byte_i < byte_cnt)
+        syndrome_scalar(p_out + byte_i, q_out + byte_i, tail_data, data_cnt, byte_cnt - byte_i);
+}
+
+__attribute__((target("avx2")))
+void CGfKernel::mul_xor_avx2(void *dst, const void *src, const uint8_t coef, const int byte_cnt) {
+    auto out = static_cast<char *>(dst);
+    auto in = static_cast<const char *>(src);
+    const __m256i mul_lo = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables().m_mul_lo[coef])));
+    const __m256i mul_hi = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(tables().m_mul_hi[coef])));
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+    int byte_i = 0;
+
+    // Product of each byte is the xor of the products of its nibbles, looked up with PSHUFB in both lanes
+    for (; byte_i + 32 <= byte_cnt; byte_i += 32) {
+        const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + byte_i));
+        const __m256i lo = _mm256_and_si256(value, nibble_mask);
+        const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(value, 4), nibble_mask);
+        const __m256i product = _mm256_xor_si256(_mm256_shuffle_epi8(mul_lo, lo), _mm256_shuffle_epi8(mul_hi, hi));
+        __m256i acc = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(out + byte_i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + byte_i), _mm256_xor_si256(acc, product));
+    }
+
+    // Remaining bytes
+    mul_xor_scalar(out + byte_i, in + byte_i, coef, byte_cnt - byte_i);
+}
+#endif /* RAID_XOR_X86 */
+
+/// Computes CRC32C (Castagnoli polynomial) of a byte range, table driven
+/// @param data in, bytes to checksum
+/// @param byte_cnt in, number of bytes
+/// @param crc in, checksum of preceding bytes to continue from, 0 for the first range
+/// @return uint32_t, checksum
+inline uint32_t crc32c(const void *data, const size_t byte_cnt, uint32_t crc = 0) {
+    struct CTable {
+        CTable() {
+            for (uint32_t byte = 0; byte < 256; byte++) {
+                uint32_t value = byte;
+                for (int bit_i = 0; bit_i < 8; bit_i++)
+                    value = (value >> 1) ^ (value & 1 ? 0x82f63b78u : 0);
+                m_values[byte] = value;
+            }
+        }
+
+        uint32_t m_values[256];
+    };
+    static const CTable table;
+
+    auto bytes = static_cast<const unsigned char *>(data);
+    crc = ~crc;
+    for (size_t byte_i = 0; byte_i < byte_cnt; byte_i++)
+        crc = (crc >> 8) ^ table.m_values[(crc ^ bytes[byte_i]) & 0xff];
+    return ~crc;
+}
+
+/// Chunked left-symmetric stripe layout of a RAID
+/// Each drive holds m_chunk_sectors consecutive raid sectors before the next drive takes over, parity moves one
+/// drive to the left per stripe and data chunks follow the parity drive (the Q drive follows P with dual parity).
+/// Drives of a stripe only depend on stripe % m_devices, so they are precomputed into tables.
+struct CRaidGeometry {
+    CRaidGeometry() = default;
+
+    explicit CRaidGeometry(int devices, int chunk_sectors, int parity_cnt = 1);
 
     /// Calculate physical drive, sector and parity drive indices based on a raid sector index
     /// @param raid_sector input raid sector index
@@ -121,483 +1066,4214 @@ protected:
     /// @param parity_drive_i output parity drive index
     void raid_sector_to_physical(int raid_sector, int &drive_i, int &drive_sector_i, int &parity_drive_i) const;
 
-    /// Clears & resets all member variables to default
-    /// (frees m_dev ptr)
-    void clear_raid_volume_data();
+    /// Returns parity drive index of a stripe row
+    /// @param sector_i in, index of row drive sector
+    /// @return int, parity drive index
+    int parity_drive_of(int sector_i) const;
 
-    /// Returns data or parity by xoring sectors from other drives.
-    /// @param out_buffer out, int buffer of SECTOR_SIZE Bytes
-    /// @param dead_drive_i in, index of faulty drive
-    /// @param sector_i in, index of faulty drive sector
-    /// @return bool, reading success
-    int xor_read_without_sector(INT_SECTOR_BUFFER(out_buffer), int dead_drive_i, int sector_i) const;
+    /// Returns drive index holding a data chunk of a stripe row
+    /// @param sector_i in, index of row drive sector
+    /// @param chunk_i in, index of data chunk in the stripe (0... data_drive_cnt()-1)
+    /// @return int, data drive index
+    int data_drive_of(int sector_i, int chunk_i) const;
 
-    int xor_get_parity_supplement_dead_sector(INT_SECTOR_BUFFER(out_buffer), int parity_drive_i,
-                                              int dead_drive_i,
-                                              const INT_SECTOR_BUFFER(dead_drive_supplement_buffer),
-                                              int sector_i) const;
+    /// Returns Q syndrome drive index of a stripe row
+    /// @param sector_i in, index of row drive sector
+    /// @return int, Q drive index, -1 with single parity
+    int q_drive_of(int sector_i) const;
 
-    /// Outputs xor of provided buffers into out_buffer
-    /// @param out_buffer xor operand, output buffer
-    /// @param in_buffer xor operand
-    static inline void xor_int_buffers(INT_SECTOR_BUFFER(out_buffer), const INT_SECTOR_BUFFER(in_buffer));
+    /// Lists drives of a stripe row in block order, data chunks followed by P & Q
+    /// @param sector_i in, index of row drive sector
+    /// @param drives out, m_devices drive indices
+    void stripe_drives_of(int sector_i, int drives[MAX_RAID_DEVICES]) const;
 
+    /// Returns number of data chunks of a stripe
+    /// @return int, m_devices - m_parity_cnt
+    int data_drive_cnt() const;
 
-    // Tblkdev interface ptr
-    TBlkDev *m_dev = nullptr;
-    // Metadata sector index & metadata ptr
-    int m_metadata_sector = 0;
-    CDriveMetadata m_metadata = {};
-    // Current RAID status
-    int m_status = RAID_STOPPED;
-    // Current RAID size
-    int m_raid_size = 0;
-    // Member R/W buffer
-    INT_SECTOR_BUFFER(m_buffer);
+    /// Returns number of raid sectors of a stripe
+    /// @return int, m_chunk_sectors * data_drive_cnt()
+    int stripe_sector_cnt() const;
+
+    int m_devices = MIN_RAID_DEVICES;
+    int m_chunk_sectors = 1;
+    // Parity drives of each stripe, 1 (P) or 2 (P & Q syndrome)
+    int m_parity_cnt = 1;
+    // Parity drive, Q drive (-1 if none) & data chunk drives of a stripe, indexed by stripe % m_devices
+    int m_parity_drive[MAX_RAID_DEVICES] = {};
+    int m_q_drive[MAX_RAID_DEVICES] = {};
+    int m_data_drive[MAX_RAID_DEVICES][MAX_RAID_DEVICES - 1] = {};
 };
 
-CRaidVolume::CRaidVolume() {
-    clear_raid_volume_data();
+CRaidGeometry::CRaidGeometry(const int devices, const int chunk_sectors, const int parity_cnt)
+    : m_devices(devices), m_chunk_sectors(chunk_sectors), m_parity_cnt(parity_cnt) {
+    for (int stripe_i = 0; stripe_i < m_devices; stripe_i++) {
+        m_parity_drive[stripe_i] = (m_devices - 1) - stripe_i;
+        m_q_drive[stripe_i] = m_parity_cnt > 1 ? (m_parity_drive[stripe_i] + 1) % m_devices : -1;
+        for (int chunk_i = 0; chunk_i < data_drive_cnt(); chunk_i++)
+            m_data_drive[stripe_i][chunk_i] = (m_parity_drive[stripe_i] + m_parity_cnt + chunk_i) % m_devices;
+    }
+}
+
+void CRaidGeometry::raid_sector_to_physical(const int raid_sector, int &drive_i, int &drive_sector_i,
+                                            int &parity_drive_i) const {
+    const int chunk_i = raid_sector / m_chunk_sectors;
+    const int stripe_i = chunk_i / data_drive_cnt();
+
+    drive_sector_i = stripe_i * m_chunk_sectors + raid_sector % m_chunk_sectors;
+    parity_drive_i = m_parity_drive[stripe_i % m_devices];
+    drive_i = m_data_drive[stripe_i % m_devices][chunk_i % data_drive_cnt()];
+}
+
+int CRaidGeometry::parity_drive_of(const int sector_i) const {
+    return m_parity_drive[(sector_i / m_chunk_sectors) % m_devices];
+}
+
+int CRaidGeometry::data_drive_of(const int sector_i, const int chunk_i) const {
+    return m_data_drive[(sector_i / m_chunk_sectors) % m_devices][chunk_i];
+}
+
+int CRaidGeometry::q_drive_of(const int sector_i) const {
+    return m_q_drive[(sector_i / m_chunk_sectors) % m_devices];
+}
+
+void CRaidGeometry::stripe_drives_of(const int sector_i, int drives[MAX_RAID_DEVICES]) const {
+    const int stripe_mod = (sector_i / m_chunk_sectors) % m_devices;
+    for (int chunk_i = 0; chunk_i < data_drive_cnt(); chunk_i++)
+        drives[chunk_i] = m_data_drive[stripe_mod][chunk_i];
+    drives[data_drive_cnt()] = m_parity_drive[stripe_mod];
+    if (m_parity_cnt > 1)
+        drives[data_drive_cnt() + 1] = m_q_drive[stripe_mod];
+}
+
+int CRaidGeometry::data_drive_cnt() const {
+    return m_devices - m_parity_cnt;
+}
+
+int CRaidGeometry::stripe_sector_cnt() const {
+    return m_chunk_sectors * data_drive_cnt();
+}
+
+/// Walks consecutive raid sectors, the translation is computed once and then advanced without divisions
+class CStripeIterator {
+public:
+    /// @param geometry layout to translate with, has to outlive the iterator
+    /// @param raid_sector first raid sector
+    CStripeIterator(const CRaidGeometry &geometry, int raid_sector);
+
+    /// Moves to the next raid sector
+    void next();
+
+    // Current raid sector & its drive, drive sector and parity drive indices
+    int m_raid_sector;
+    int m_drive_i = 0;
+    int m_drive_sector_i = 0;
+    int m_parity_drive_i = 0;
+
+protected:
+    const CRaidGeometry &m_geometry;
+    // Data chunk index in stripe, sector offset in chunk, stripe index & stripe % devices
+    int m_chunk_i;
+    int m_chunk_offset;
+    int m_stripe_i;
+    int m_stripe_mod;
+};
+
+CStripeIterator::CStripeIterator(const CRaidGeometry &geometry, const int raid_sector)
+    : m_raid_sector(raid_sector), m_geometry(geometry) {
+    const int chunk_i = raid_sector / geometry.m_chunk_sectors;
+    m_chunk_i = chunk_i % geometry.data_drive_cnt();
+    m_chunk_offset = raid_sector % geometry.m_chunk_sectors;
+    m_stripe_i = chunk_i / geometry.data_drive_cnt();
+    m_stripe_mod = m_stripe_i % geometry.m_devices;
+
+    m_drive_i = geometry.m_data_drive[m_stripe_mod][m_chunk_i];
+    m_drive_sector_i = m_stripe_i * geometry.m_chunk_sectors + m_chunk_offset;
+    m_parity_drive_i = geometry.m_parity_drive[m_stripe_mod];
+}
+
+void CStripeIterator::next() {
+    m_raid_sector++;
+    m_drive_sector_i++;
+    if (++m_chunk_offset < m_geometry.m_chunk_sectors)
+        return;
+
+    // Next chunk of the stripe, back to its first row
+    m_chunk_offset = 0;
+    m_drive_sector_i -= m_geometry.m_chunk_sectors;
+    if (++m_chunk_i == m_geometry.data_drive_cnt()) {
+        // Next stripe
+        m_chunk_i = 0;
+        m_stripe_i++;
+        m_drive_sector_i += m_geometry.m_chunk_sectors;
+        if (++m_stripe_mod == m_geometry.m_devices)
+            m_stripe_mod = 0;
+        m_parity_drive_i = m_geometry.m_parity_drive[m_stripe_mod];
+    }
+    m_drive_i = m_geometry.m_data_drive[m_stripe_mod][m_chunk_i];
+}
+
+/// Reader/writer locks of stripes, a stripe uses lock stripe_i % STRIPE_LOCK_CNT
+/// Ranges are locked in ascending lock order, so overlapping ranges never deadlock
+class CStripeLockTable {
+public:
+    /// Locks stripes [first_stripe_i, last_stripe_i]
+    /// @param first_stripe_i in, index of first stripe
+    /// @param last_stripe_i in, index of last stripe
+    /// @param exclusive in, exclusive (write) or shared (read) lock
+    void lock(int first_stripe_i, int last_stripe_i, bool exclusive);
+
+    /// Unlocks stripes [first_stripe_i, last_stripe_i] locked by lock()
+    /// @param first_stripe_i in, index of first stripe
+    /// @param last_stripe_i in, index of last stripe
+    /// @param exclusive in, lock mode used by lock()
+    void unlock(int first_stripe_i, int last_stripe_i, bool exclusive);
+
+    /// Locks stripes of a stripe set, each shared lock once in ascending lock order
+    /// @param stripes in, indices of stripes in any order, may repeat
+    /// @param exclusive in, exclusive (write) or shared (read) lock
+    /// @return vector<int>, indices of taken locks to pass to unlock_set()
+    vector<int> lock_set(const vector<int> &stripes, bool exclusive);
+
+    /// Unlocks locks taken by lock_set()
+    /// @param lock_ids in, indices of locks returned by lock_set()
+    /// @param exclusive in, lock mode used by lock_set()
+    void unlock_set(const vector<int> &lock_ids, bool exclusive);
+
+protected:
+    /// Calls func for every lock of a stripe range in ascending lock order
+    /// @param first_stripe_i in, index of first stripe
+    /// @param last_stripe_i in, index of last stripe
+    /// @param func in, called with the lock
+    template<typename TFunc>
+    void for_each_lock(int first_stripe_i, int last_stripe_i, TFunc func);
+
+    shared_mutex m_locks[STRIPE_LOCK_CNT];
+};
+
+template<typename TFunc>
+void CStripeLockTable::for_each_lock(const int first_stripe_i, const int last_stripe_i, TFunc func) {
+    const int lock_cnt = min(STRIPE_LOCK_CNT, last_stripe_i - first_stripe_i + 1);
+    const int first_lock_i = first_stripe_i % STRIPE_LOCK_CNT;
+    const int wrapped_cnt = max(0, first_lock_i + lock_cnt - STRIPE_LOCK_CNT);
+
+    // Locks wrapped past the table end have lower indices, take them first
+    for (int lock_i = 0; lock_i < wrapped_cnt; lock_i++)
+        func(m_locks[lock_i]);
+    for (int lock_i = first_lock_i; lock_i < first_lock_i + lock_cnt - wrapped_cnt; lock_i++)
+        func(m_locks[lock_i]);
+}
+
+void CStripeLockTable::lock(const int first_stripe_i, const int last_stripe_i, const bool exclusive) {
+    for_each_lock(first_stripe_i, last_stripe_i, [exclusive](shared_mutex &lock) {
+        if (exclusive)
+            lock.lock();
+        else
+            lock.lock_shared();
+    });
+}
+
+void CStripeLockTable::unlock(const int first_stripe_i, const int last_stripe_i, const bool exclusive) {
+    for_each_lock(first_stripe_i, last_stripe_i, [exclusive](shared_mutex &lock) {
+        if (exclusive)
+            lock.unlock();
+        else
+            lock.unlock_shared();
+    });
+}
+
+vector<int> CStripeLockTable::lock_set(const vector<int> &stripes, const bool exclusive) {
+    vector<int> lock_ids;
+    lock_ids.reserve(stripes.size());
+    for (const int stripe_i : stripes)
+        lock_ids.push_back(stripe_i % STRIPE_LOCK_CNT);
+    sort(lock_ids.begin(), lock_ids.end());
+    lock_ids.erase(unique(lock_ids.begin(), lock_ids.end()), lock_ids.end());
+
+    for (const int lock_i : lock_ids) {
+        if (exclusive)
+            m_locks[lock_i].lock();
+        else
+            m_locks[lock_i].lock_shared();
+    }
+    return lock_ids;
+}
+
+void CStripeLockTable::unlock_set(const vector<int> &lock_ids, const bool exclusive) {
+    for (const int lock_i : lock_ids) {
+        if (exclusive)
+            m_locks[lock_i].unlock();
+        else
+            m_locks[lock_i].unlock_shared();
+    }
+}
+
+/// Holds stripe locks of a stripe range or a stripe set for its lifetime
+class CStripeLockGuard {
+public:
+    /// @param table lock table, has to outlive the guard
+    /// @param first_stripe_i index of first stripe
+    /// @param last_stripe_i index of last stripe
+    /// @param exclusive exclusive (write) or shared (read) lock
+    CStripeLockGuard(CStripeLockTable &table, int first_stripe_i, int last_stripe_i, bool exclusive)
+        : m_table(table), m_first_stripe_i(first_stripe_i), m_last_stripe_i(last_stripe_i), m_exclusive(exclusive) {
+        m_table.lock(m_first_stripe_i, m_last_stripe_i, m_exclusive);
+    }
+
+    /// @param table lock table, has to outlive the guard
+    /// @param stripes indices of stripes in any order
+    /// @param exclusive exclusive (write) or shared (read) lock
+    CStripeLockGuard(CStripeLockTable &table, const vector<int> &stripes, bool exclusive)
+        : m_table(table), m_first_stripe_i(0), m_last_stripe_i(-1), m_exclusive(exclusive),
+          m_lock_ids(m_table.lock_set(stripes, m_exclusive)) {
+    }
+
+    ~CStripeLockGuard() {
+        if (m_last_stripe_i < m_first_stripe_i)
+            m_table.unlock_set(m_lock_ids, m_exclusive);
+        else
+            m_table.unlock(m_first_stripe_i, m_last_stripe_i, m_exclusive);
+    }
+
+    CStripeLockGuard(const CStripeLockGuard &) = delete;
+
+    CStripeLockGuard &operator=(const CStripeLockGuard &) = delete;
+
+protected:
+    CStripeLockTable &m_table;
+    int m_first_stripe_i;
+    int m_last_stripe_i;
+    bool m_exclusive;
+    // Locks of a stripe set, empty range [m_first_stripe_i, m_last_stripe_i] marks a set guard
+    vector<int> m_lock_ids;
+};
+
+uint64_t CLatencyHistogram::percentile_us(const double percentile) const {
+    if (m_count == 0)
+        return 0;
+    // Rank of the percentile among recorded latencies, 1 based
+    const uint64_t rank =
+        max<uint64_t>(1, static_cast<uint64_t>(percentile / 100 * static_cast<double>(m_count) + 0.5));
+    uint64_t counted = 0;
+    for (int bucket_i = 0; bucket_i < LATENCY_BUCKET_CNT; bucket_i++) {
+        counted += m_buckets[bucket_i];
+        if (counted >= rank)
+            return uint64_t(1) << bucket_i;
+    }
+    return uint64_t(1) << (LATENCY_BUCKET_CNT - 1);
+}
+
+/// CLatencyHistogram recorded concurrently without locks
+class CLatencyRecorder {
+public:
+    /// Counts one latency
+    /// @param latency_us in, latency in microseconds
+    void record(const uint64_t latency_us) {
+        int bucket_i = 0;
+        while (bucket_i < LATENCY_BUCKET_CNT - 1 && latency_us >= (uint64_t(1) << bucket_i))
+            bucket_i++;
+        m_buckets[bucket_i].fetch_add(1, memory_order_relaxed);
+        m_count.fetch_add(1, memory_order_relaxed);
+        m_total_us.fetch_add(latency_us, memory_order_relaxed);
+    }
+
+    /// Copies counts, concurrent records may be partially included
+    /// @param histogram out, recorded latencies
+    void snapshot(CLatencyHistogram &histogram) const {
+        for (int bucket_i = 0; bucket_i < LATENCY_BUCKET_CNT; bucket_i++)
+            histogram.m_buckets[bucket_i] = m_buckets[bucket_i].load(memory_order_relaxed);
+        histogram.m_count = m_count.load(memory_order_relaxed);
+        histogram.m_total_us = m_total_us.load(memory_order_relaxed);
+    }
+
+    void reset() {
+        for (atomic<uint64_t> &bucket : m_buckets)
+            bucket.store(0, memory_order_relaxed);
+        m_count.store(0, memory_order_relaxed);
+        m_total_us.store(0, memory_order_relaxed);
+    }
+
+protected:
+    atomic<uint64_t> m_buckets[LATENCY_BUCKET_CNT] = {};
+    atomic<uint64_t> m_count{0};
+    atomic<uint64_t> m_total_us{0};
+};
+
+/// Returns microseconds elapsed since start
+/// @param start in, time point to measure from
+/// @return uint64_t, elapsed microseconds
+inline uint64_t elapsed_us(const chrono::steady_clock::time_point &start) {
+    return static_cast<uint64_t>(
+        chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count());
+}
+
+/// One device call of a CDriveIoEngine batch
+struct CDriveIo {
+    int m_drive_i = 0;
+    int m_sector_i = 0;
+    int m_sector_cnt = 0;
+    // Read destination, nullptr for writes
+    void *m_read_buffer = nullptr;
+    // Write source, nullptr for reads
+    const void *m_write_buffer = nullptr;
+};
+
+/// Device layer executing whole batches of device calls, e.g. with asynchronous kernel I/O
+/// Extends TBlkDev for backends able to keep many calls in flight, execute() is called concurrently
+class CDriveIoBackend {
+public:
+    virtual ~CDriveIoBackend() = default;
+
+    /// Executes device calls & waits for all of them, calls of one batch may run in any order
+    /// A failed call doesn't stop the others, each call reports its own status
+    /// @param ios in, device calls
+    /// @param io_cnt in, number of device calls
+    /// @param io_failed out, io_cnt flags, set for each failed call
+    /// @return int, drive index of the first failed call (in ios order), -1 on success
+    virtual int execute(const CDriveIo *ios, int io_cnt, bool *io_failed) = 0;
+};
+
+/// Runs device calls of a batch in parallel, one worker thread & queue per drive
+/// Latency of a batch is that of its slowest drive instead of the sum of all drives
+/// Batches are passed to a CDriveIoBackend instead if one is set
+/// Calls address drive indices, each served by a TBlkDev drive (the same one unless remapped by map_drive())
+class CDriveIoEngine {
+public:
+    CDriveIoEngine() = default;
+
+    ~CDriveIoEngine();
+
+    CDriveIoEngine(const CDriveIoEngine &) = delete;
+
+    CDriveIoEngine &operator=(const CDriveIoEngine &) = delete;
+
+    /// Starts one worker per drive, or none if batches are executed by a backend
+    /// @param dev TBlkDev interface the calls are issued to
+    /// @param backend in, backend executing batches, nullptr to issue TBlkDev calls
+    void start(const TBlkDev &dev, CDriveIoBackend *backend = nullptr);
+
+    /// Finishes queued calls & joins workers, execute() runs calls on the calling thread afterwards
+    void stop();
+
+    /// Serves drives added to TBlkDev, starts workers of the added drives
+    /// No calls may be in flight, a backend has to serve the added drives as well
+    /// @param dev TBlkDev interface with the added drives, the others keep their indices
+    void add_drives(const TBlkDev &dev);
+
+    /// Routes calls of a drive index to another TBlkDev drive, calls already issued aren't affected
+    /// @param drive_i in, index of drive
+    /// @param device_i in, index of TBlkDev drive serving it
+    void map_drive(int drive_i, int device_i);
+
+    /// Executes device calls & waits for all of them, the first call runs on the calling thread
+    /// Calls of one batch may run in any order, a batch should have at most one call per drive
+    /// @param ios in, device calls
+    /// @param io_cnt in, number of device calls
+    /// @return int, drive index of the first failed call (in ios order), -1 on success
+    int execute(const CDriveIo *ios, int io_cnt);
+
+    /// Reads sectors of a drive on the calling thread, counted like calls of execute()
+    /// @param drive_i in, index of drive
+    /// @param sector_i in, index of first drive sector
+    /// @param data out, sector_cnt sectors
+    /// @param sector_cnt in, number of sectors
+    /// @return bool, all sectors were read
+    bool read(int drive_i, int sector_i, void *data, int sector_cnt);
+
+    /// Writes sectors of a drive on the calling thread, counted like calls of execute()
+    /// @param drive_i in, index of drive
+    /// @param sector_i in, index of first drive sector
+    /// @param data in, sector_cnt sectors
+    /// @param sector_cnt in, number of sectors
+    /// @return bool, all sectors were written
+    bool write(int drive_i, int sector_i, const void *data, int sector_cnt);
+
+    /// Copies counters & call latencies of all TBlkDev drives
+    /// @param stats out, drive counters & m_drive_cnt are set
+    void stats(CRaidStats &stats) const;
+
+    /// Clears counters & call latencies of all drives
+    void reset_stats();
+
+protected:
+    /// Completion state of one execute() call
+    struct CBatch {
+        mutex m_mutex;
+        condition_variable m_done;
+        int m_pending = 0;
+        // Index of the first failed call in ios, INT_MAX if none
+        int m_failed_io_i = INT_MAX;
+    };
+
+    struct CQueuedIo {
+        const CDriveIo *m_io;
+        int m_io_i;
+        CBatch *m_batch;
+    };
+
+    struct CWorker {
+        thread m_thread;
+        mutex m_mutex;
+        condition_variable m_wake;
+        deque<CQueuedIo> m_queue;
+        bool m_stop = false;
+    };
+
+    /// Issues a single device call to the TBlkDev drive serving its drive index & counts it
+    /// @param io in, device call
+    /// @return bool, all sectors were read/written
+    bool run(const CDriveIo &io);
+
+    /// Counts a finished device call
+    /// @param device_i in, index of TBlkDev drive which served the call
+    /// @param io in, device call
+    /// @param success in, all sectors were read/written
+    /// @param latency_us in, duration of the call
+    void count(int device_i, const CDriveIo &io, bool success, uint64_t latency_us);
+
+    /// Executes calls queued for a drive until stop()
+    /// @param worker in, worker of the drive
+    void worker_loop(CWorker &worker);
+
+    TBlkDev m_dev = {};
+    CDriveIoBackend *m_backend = nullptr;
+    // TBlkDev drive of each drive index, workers & counters belong to TBlkDev drives
+    atomic<int> m_drive_devices[MAX_RAID_DEVICES] = {};
+    CWorker m_workers[MAX_RAID_DEVICES];
+    int m_worker_cnt = 0;
+    atomic<uint64_t> m_drive_counters[MAX_RAID_DEVICES][DRIVE_COUNTER_CNT] = {};
+    CLatencyRecorder m_drive_latency[MAX_RAID_DEVICES];
+};
+
+CDriveIoEngine::~CDriveIoEngine() {
+    stop();
+}
+
+void CDriveIoEngine::start(const TBlkDev &dev, CDriveIoBackend *backend) {
+    stop();
+    m_dev = dev;
+    m_backend = backend;
+    for (int drive_i = 0; drive_i < MAX_RAID_DEVICES; drive_i++)
+        m_drive_devices[drive_i] = drive_i;
+    if (m_backend)
+        return;
+    for (m_worker_cnt = 0; m_worker_cnt < dev.m_Devices; m_worker_cnt++) {
+        CWorker &worker = m_workers[m_worker_cnt];
+        worker.m_stop = false;
+        worker.m_thread = thread([this, &worker] { worker_loop(worker); });
+    }
+}
+
+void CDriveIoEngine::stop() {
+    for (int worker_i = 0; worker_i < m_worker_cnt; worker_i++) {
+        CWorker &worker = m_workers[worker_i];
+        {
+            lock_guard<mutex> worker_lock(worker.m_mutex);
+            worker.m_stop = true;
+        }
+        worker.m_wake.notify_one();
+        worker.m_thread.join();
+    }
+    m_worker_cnt = 0;
+    m_backend = nullptr;
+}
+
+void CDriveIoEngine::add_drives(const TBlkDev &dev) {
+    m_dev = dev;
+    if (m_backend)
+        return;
+    for (; m_worker_cnt < dev.m_Devices; m_worker_cnt++) {
+        CWorker &worker = m_workers[m_worker_cnt];
+        worker.m_stop = false;
+        worker.m_thread = thread([this, &worker] { worker_loop(worker); });
+    }
+}
+
+void CDriveIoEngine::map_drive(const int drive_i, const int device_i) {
+    m_drive_devices[drive_i] = device_i;
+}
+
+int CDriveIoEngine::execute(const CDriveIo *ios, const int io_cnt) {
+    if (m_backend) {
+        if (io_cnt <= 0)
+            return -1;
+        // Backend addresses TBlkDev drives
+        vector<CDriveIo> device_ios(ios, ios + io_cnt);
+        for (CDriveIo &io : device_ios)
+            io.m_drive_i = m_drive_devices[io.m_drive_i];
+
+        const auto start = chrono::steady_clock::now();
+        const auto io_failed = make_unique<bool[]>(io_cnt);
+        m_backend->execute(device_ios.data(), io_cnt, io_failed.get());
+        // Calls of a batch overlap, each is charged the time of the whole batch
+        const uint64_t latency_us = elapsed_us(start);
+        int failed_drive = -1;
+        for (int io_i = 0; io_i < io_cnt; io_i++) {
+            count(device_ios[io_i].m_drive_i, ios[io_i], !io_failed[io_i], latency_us);
+            if (io_failed[io_i] && failed_drive < 0)
+                failed_drive = ios[io_i].m_drive_i;
+        }
+        return failed_drive;
+    }
+
+    // No workers or nothing to overlap, run on the calling thread
+    if (m_worker_cnt == 0 || io_cnt <= 1) {
+        for (int io_i = 0; io_i < io_cnt; io_i++)
+            if (!run(ios[io_i]))
+                return ios[io_i].m_drive_i;
+        return -1;
+    }
+
+    CBatch batch;
+    batch.m_pending = io_cnt - 1;
+    for (int io_i = 1; io_i < io_cnt; io_i++) {
+        CWorker &worker = m_workers[m_drive_devices[ios[io_i].m_drive_i]];
+        {
+            lock_guard<mutex> worker_lock(worker.m_mutex);
+            worker.m_queue.push_back({&ios[io_i], io_i, &batch});
+        }
+        worker.m_wake.notify_one();
+    }
+
+    const bool first_ok = run(ios[0]);
+
+    unique_lock<mutex> batch_lock(batch.m_mutex);
+    batch.m_done.wait(batch_lock, [&batch] { return batch.m_pending == 0; });
+    if (!first_ok)
+        return ios[0].m_drive_i;
+    return batch.m_failed_io_i == INT_MAX ? -1 : ios[batch.m_failed_io_i].m_drive_i;
+}
+
+bool CDriveIoEngine::run(const CDriveIo &io) {
+    const int device_i = m_drive_devices[io.m_drive_i];
+    const auto start = chrono::steady_clock::now();
+    const bool success =
+        io.m_read_buffer
+            ? m_dev.m_Read(device_i, io.m_sector_i, io.m_read_buffer, io.m_sector_cnt) == io.m_sector_cnt
+            : m_dev.m_Write(device_i, io.m_sector_i, io.m_write_buffer, io.m_sector_cnt) == io.m_sector_cnt;
+    count(device_i, io, success, elapsed_us(start));
+    return success;
+}
+
+void CDriveIoEngine::count(const int device_i, const CDriveIo &io, const bool success, const uint64_t latency_us) {
+    if (device_i < 0 || device_i >= MAX_RAID_DEVICES)
+        return;
+    atomic<uint64_t> *counters = m_drive_counters[device_i];
+    const bool read = io.m_read_buffer != nullptr;
+    counters[read ? DRIVE_READS : DRIVE_WRITES].fetch_add(1, memory_order_relaxed);
+    counters[read ? DRIVE_READ_SECTORS : DRIVE_WRITTEN_SECTORS].fetch_add(io.m_sector_cnt, memory_order_relaxed);
+    if (!success)
+        counters[DRIVE_ERRORS].fetch_add(1, memory_order_relaxed);
+    counters[DRIVE_BUSY_US].fetch_add(latency_us, memory_order_relaxed);
+    m_drive_latency[device_i].record(latency_us);
+}
+
+bool CDriveIoEngine::read(const int drive_i, const int sector_i, void *data, const int sector_cnt) {
+    CDriveIo io;
+    io.m_drive_i = drive_i;
+    io.m_sector_i = sector_i;
+    io.m_sector_cnt = sector_cnt;
+    io.m_read_buffer = data;
+    return run(io);
+}
+
+bool CDriveIoEngine::write(const int drive_i, const int sector_i, const void *data, const int sector_cnt) {
+    CDriveIo io;
+    io.m_drive_i = drive_i;
+    io.m_sector_i = sector_i;
+    io.m_sector_cnt = sector_cnt;
+    io.m_write_buffer = data;
+    return run(io);
+}
+
+void CDriveIoEngine::stats(CRaidStats &stats) const {
+    stats.m_drive_cnt = m_dev.m_Devices;
+    for (int drive_i = 0; drive_i < MAX_RAID_DEVICES; drive_i++) {
+        for (int counter_i = 0; counter_i < DRIVE_COUNTER_CNT; counter_i++)
+            stats.m_drives[drive_i][counter_i] = m_drive_counters[drive_i][counter_i].load(memory_order_relaxed);
+        m_drive_latency[drive_i].snapshot(stats.m_drive_latency[drive_i]);
+    }
+}
+
+void CDriveIoEngine::reset_stats() {
+    for (int drive_i = 0; drive_i < MAX_RAID_DEVICES; drive_i++) {
+        for (atomic<uint64_t> &counter : m_drive_counters[drive_i])
+            counter.store(0, memory_order_relaxed);
+        m_drive_latency[drive_i].reset();
+    }
+}
+
+void CDriveIoEngine::worker_loop(CWorker &worker) {
+    unique_lock<mutex> worker_lock(worker.m_mutex);
+    while (true) {
+        worker.m_wake.wait(worker_lock, [&worker] { return worker.m_stop || !worker.m_queue.empty(); });
+        if (worker.m_queue.empty())
+            return;
+
+        const CQueuedIo queued = worker.m_queue.front();
+        worker.m_queue.pop_front();
+        worker_lock.unlock();
+
+        const bool io_ok = run(*queued.m_io);
+
+        // Batch may be destroyed as soon as its last call is counted
+        {
+            lock_guard<mutex> batch_lock(queued.m_batch->m_mutex);
+            if (!io_ok)
+                queued.m_batch->m_failed_io_i = min(queued.m_batch->m_failed_io_i, queued.m_io_i);
+            if (--queued.m_batch->m_pending == 0)
+                queued.m_batch->m_done.notify_one();
+        }
+        worker_lock.lock();
+    }
+}
+
+/// Runs submitted tasks on a fixed pool of threads
+class CRequestExecutor {
+public:
+    CRequestExecutor() = default;
+
+    ~CRequestExecutor();
+
+    CRequestExecutor(const CRequestExecutor &) = delete;
+
+    CRequestExecutor &operator=(const CRequestExecutor &) = delete;
+
+    /// Starts worker threads
+    /// @param worker_cnt number of threads
+    void start(int worker_cnt);
+
+    /// Finishes queued tasks & joins workers
+    void stop();
+
+    /// Queues a task
+    /// @param task in, task to run
+    /// @return bool, false if the executor isn't started (task is not run)
+    bool submit(function<void()> task);
+
+    /// Waits until all submitted tasks finished
+    void wait_idle();
+
+    /// Returns number of submitted tasks that didn't finish yet
+    /// @return int, number of queued & running tasks
+    int pending() const;
+
+protected:
+    /// Runs queued tasks until stop()
+    void worker_loop();
+
+    mutable mutex m_mutex;
+    condition_variable m_wake;
+    condition_variable m_idle;
+    deque<function<void()>> m_queue;
+    vector<thread> m_workers;
+    // Queued & running tasks
+    int m_pending = 0;
+    bool m_stop = false;
+};
+
+CRequestExecutor::~CRequestExecutor() {
+    stop();
+}
+
+void CRequestExecutor::start(const int worker_cnt) {
+    stop();
+    m_stop = false;
+    for (int worker_i = 0; worker_i < worker_cnt; worker_i++)
+        m_workers.emplace_back(&CRequestExecutor::worker_loop, this);
+}
+
+void CRequestExecutor::stop() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (thread &worker : m_workers)
+        worker.join();
+    m_workers.clear();
+}
+
+bool CRequestExecutor::submit(function<void()> task) {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (m_stop || m_workers.empty())
+            return false;
+        m_queue.push_back(move(task));
+        m_pending++;
+    }
+    m_wake.notify_one();
+    return true;
+}
+
+void CRequestExecutor::wait_idle() {
+    unique_lock<mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_pending == 0; });
+}
+
+int CRequestExecutor::pending() const {
+    lock_guard<mutex> lock(m_mutex);
+    return m_pending;
+}
+
+void CRequestExecutor::worker_loop() {
+    unique_lock<mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty())
+            return;
+
+        function<void()> task = move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+
+        task();
+
+        lock.lock();
+        if (--m_pending == 0)
+            m_idle.notify_all();
+    }
+}
+
+/// Bounded LRU cache of failed drive sectors reconstructed from parity, keyed by row drive sector index
+class CRowCache {
+public:
+    /// @param capacity maximum number of cached sectors
+    explicit CRowCache(int capacity);
+
+    /// Copies a cached sector of a row
+    /// @param sector_i in, index of row drive sector
+    /// @param drive_i in, index of reconstructed drive
+    /// @param out out, SECTOR_SIZE Bytes
+    /// @return bool, sector was cached
+    bool get(int sector_i, int drive_i, void *out);
+
+    /// Caches a reconstructed sector of a row, evicts the least recently used one when full
+    /// @param sector_i in, index of row drive sector
+    /// @param drive_i in, index of reconstructed drive
+    /// @param data in, SECTOR_SIZE Bytes
+    void put(int sector_i, int drive_i, const void *data);
+
+    /// Drops cached sectors of rows [sector_i, sector_i + sector_cnt)
+    /// @param sector_i in, index of first row drive sector
+    /// @param sector_cnt in, number of rows
+    void invalidate(int sector_i, int sector_cnt);
+
+    /// Drops all cached sectors
+    void clear();
+
+protected:
+    struct CEntry {
+        int m_sector_i;
+        int m_drive_i;
+        unsigned char m_data[SECTOR_SIZE];
+    };
+
+    mutex m_mutex;
+    int m_capacity;
+    // Most recently used entry first
+    list<CEntry> m_lru;
+    unordered_map<int, list<CEntry>::iterator> m_entries;
+};
+
+CRowCache::CRowCache(const int capacity) : m_capacity(capacity) {
+}
+
+bool CRowCache::get(const int sector_i, const int drive_i, void *out) {
+    lock_guard<mutex> lock(m_mutex);
+    const auto entry = m_entries.find(sector_i);
+    if (entry == m_entries.end() || entry->second->m_drive_i != drive_i)
+        return false;
+    m_lru.splice(m_lru.begin(), m_lru, entry->second);
+    memcpy(out, entry->second->m_data, SECTOR_SIZE);
+    return true;
+}
+
+void CRowCache::put(const int sector_i, const int drive_i, const void *data) {
+    lock_guard<mutex> lock(m_mutex);
+    auto entry = m_entries.find(sector_i);
+    if (entry != m_entries.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, entry->second);
+    } else if (static_cast<int>(m_lru.size()) < m_capacity) {
+        m_lru.emplace_front();
+    } else {
+        // Reuse the least recently used entry
+        m_entries.erase(m_lru.back().m_sector_i);
+        m_lru.splice(m_lru.begin(), m_lru, prev(m_lru.end()));
+    }
+
+    CEntry &front = m_lru.front();
+    front.m_sector_i = sector_i;
+    front.m_drive_i = drive_i;
+    memcpy(front.m_data, data, SECTOR_SIZE);
+    m_entries[sector_i] = m_lru.begin();
+}
+
+void CRowCache::invalidate(const int sector_i, const int sector_cnt) {
+    lock_guard<mutex> lock(m_mutex);
+    if (m_entries.empty())
+        return;
+    for (int row_i = sector_i; row_i < sector_i + sector_cnt; row_i++) {
+        const auto entry = m_entries.find(row_i);
+        if (entry == m_entries.end())
+            continue;
+        m_lru.erase(entry->second);
+        m_entries.erase(entry);
+    }
+}
+
+void CRowCache::clear() {
+    lock_guard<mutex> lock(m_mutex);
+    m_lru.clear();
+    m_entries.clear();
+}
+
+/// Write-back cache of dirty stripes, written sectors are kept in memory until the stripe is flushed
+/// Callers hold the stripe lock of a stripe while writing, reading or taking it
+class CStripeWriteCache {
+public:
+    /// Sets capacity & stripe size, drops all stripes
+    /// @param capacity maximum number of cached stripes, 0 disables the cache
+    /// @param stripe_sector_cnt number of raid sectors of a stripe
+    void configure(int capacity, int stripe_sector_cnt);
+
+    /// @return bool, cache is enabled
+    bool enabled() const;
+
+    /// Copies sectors into the cached stripe, the stripe is added if it isn't cached
+    /// @param raid_sector in, index of first raid sector
+    /// @param data in, sector_cnt sectors
+    /// @param sector_cnt in, number of sectors, must not cross the stripe end
+    void write(int raid_sector, const void *data, int sector_cnt);
+
+    /// Copies cached sectors of raid sectors [raid_sector, raid_sector + sector_cnt), other sectors are kept
+    /// @param raid_sector in, index of first raid sector
+    /// @param out out, sector_cnt sectors
+    /// @param sector_cnt in, number of sectors
+    void read(int raid_sector, void *out, int sector_cnt);
+
+    /// Returns the least recently written stripe to flush before keep_stripe_i can be added
+    /// @param keep_stripe_i in, index of stripe about to be written
+    /// @return int, index of stripe to flush, -1 if there is room or keep_stripe_i is cached
+    int eviction_candidate(int keep_stripe_i);
+
+    /// Removes a stripe from the cache
+    /// @param stripe_i in, index of stripe
+    /// @param data out, stripe sectors
+    /// @param valid out, written flag of each stripe sector
+    /// @return bool, stripe was cached
+    bool take(int stripe_i, vector<int> &data, vector<bool> &valid);
+
+    /// @return vector<int>, indices of cached stripes
+    vector<int> stripes();
+
+protected:
+    struct CEntry {
+        vector<int> m_data;
+        vector<bool> m_valid;
+        list<int>::iterator m_lru_it;
+    };
+
+    mutex m_mutex;
+    int m_capacity = 0;
+    int m_stripe_sector_cnt = 1;
+    // Most recently written stripe first
+    list<int> m_lru;
+    unordered_map<int, CEntry> m_entries;
+};
+
+void CStripeWriteCache::configure(const int capacity, const int stripe_sector_cnt) {
+    lock_guard<mutex> lock(m_mutex);
+    m_capacity = capacity;
+    m_stripe_sector_cnt = stripe_sector_cnt;
+    m_lru.clear();
+    m_entries.clear();
+}
+
+bool CStripeWriteCache::enabled() const {
+    return m_capacity > 0;
+}
+
+void CStripeWriteCache::write(const int raid_sector, const void *data, const int sector_cnt) {
+    const int stripe_i = raid_sector / m_stripe_sector_cnt;
+    const int offset = raid_sector % m_stripe_sector_cnt;
+    lock_guard<mutex> lock(m_mutex);
+
+    auto entry = m_entries.find(stripe_i);
+    if (entry == m_entries.end()) {
+        entry = m_entries.emplace(stripe_i, CEntry()).first;
+        entry->second.m_data.resize(m_stripe_sector_cnt * (SECTOR_SIZE / sizeof(int)));
+        entry->second.m_valid.assign(m_stripe_sector_cnt, false);
+        m_lru.push_front(stripe_i);
+    } else {
+        m_lru.splice(m_lru.begin(), m_lru, entry->second.m_lru_it);
+    }
+    entry->second.m_lru_it = m_lru.begin();
+
+    memcpy(entry->second.m_data.data() + offset * (SECTOR_SIZE / sizeof(int)), data, sector_cnt * SECTOR_SIZE);
+    fill_n(entry->second.m_valid.begin() + offset, sector_cnt, true);
+}
+
+void CStripeWriteCache::read(const int raid_sector, void *out, const int sector_cnt) {
+    auto cast_out = static_cast<int *>(out);
+    lock_guard<mutex> lock(m_mutex);
+    if (m_entries.empty())
+        return;
+
+    for (int raid_i = raid_sector; raid_i < raid_sector + sector_cnt;) {
+        const int stripe_i = raid_i / m_stripe_sector_cnt;
+        const int stripe_end = min(raid_sector + sector_cnt, (stripe_i + 1) * m_stripe_sector_cnt);
+        const auto entry = m_entries.find(stripe_i);
+
+        for (; entry != m_entries.end() && raid_i < stripe_end; raid_i++) {
+            const int offset = raid_i % m_stripe_sector_cnt;
+            if (entry->second.m_valid[offset])
+                memcpy(cast_out + (raid_i - raid_sector) * (SECTOR_SIZE / sizeof(int)),
+                       entry->second.m_data.data() + offset * (SECTOR_SIZE / sizeof(int)), SECTOR_SIZE);
+        }
+        raid_i = stripe_end;
+    }
+}
+
+int CStripeWriteCache::eviction_candidate(const int keep_stripe_i) {
+    lock_guard<mutex> lock(m_mutex);
+    if (static_cast<int>(m_entries.size()) < m_capacity || m_entries.count(keep_stripe_i))
+        return -1;
+    return m_lru.back();
+}
+
+bool CStripeWriteCache::take(const int stripe_i, vector<int> &data, vector<bool> &valid) {
+    lock_guard<mutex> lock(m_mutex);
+    const auto entry = m_entries.find(stripe_i);
+    if (entry == m_entries.end())
+        return false;
+    data = move(entry->second.m_data);
+    valid = move(entry->second.m_valid);
+    m_lru.erase(entry->second.m_lru_it);
+    m_entries.erase(entry);
+    return true;
+}
+
+vector<int> CStripeWriteCache::stripes() {
+    lock_guard<mutex> lock(m_mutex);
+    return {m_lru.begin(), m_lru.end()};
+}
+
+/// Read or write of a raid sector range, executed by CRaidVolume::execute_request
+struct CRaidRequest {
+    int m_sector_i = 0;
+    int m_sector_cnt = 0;
+    // Read destination, nullptr for writes
+    void *m_read_data = nullptr;
+    // Write source, nullptr for reads
+    const void *m_write_data = nullptr;
+};
+
+/// One extent of a vectored read or write (CRaidVolume::readv/writev)
+struct CRaidExtent {
+    int m_sector_i = 0;
+    int m_sector_cnt = 0;
+    // Read destination or write source of m_sector_cnt sectors
+    void *m_data = nullptr;
+};
+
+/// New sectors of the data chunks of one stripe row, nullptr if a chunk isn't written
+struct CRowWrite {
+    const int *m_data[MAX_RAID_DEVICES] = {};
+};
+
+/// Row writes keyed by row drive sector index
+using TRowWrites = map<int, CRowWrite>;
+
+/// Completion callback of a submitted request, called with the request success on an executor thread
+using TRaidCallback = function<void(bool)>;
+
+/// Write of part of a stripe, the sectors must not cross the stripe end
+struct CStripeWrite {
+    const int *m_data = nullptr;
+    int m_raid_sector = 0;
+    int m_sector_cnt = 0;
+};
+
+/// Stripe writes waiting to be committed to the write journal together, owned by the writing thread
+struct CJournalCommit {
+    const CStripeWrite *m_writes = nullptr;
+    int m_write_cnt = 0;
+    // Sequence number of the transaction holding the writes, set once written
+    int m_seq = -1;
+    bool m_done = false;
+    bool m_success = false;
+};
+
+/// Journal transaction whose journal sectors can't be reused yet
+struct CJournalTxn {
+    int m_seq = 0;
+    // First journal sector & number of sectors (header + data)
+    int m_position = 0;
+    int m_sector_cnt = 0;
+    // Number of commits not applied to the stripes yet
+    int m_pending_cnt = 0;
+};
+
+class CRaidVolume {
+public:
+    CRaidVolume();
+
+    ~CRaidVolume();
+
+    /// Initializes TBlkDev drives with metadata
+    /// Every sector of every drive is written, rows are zeroed so their parity is consistent from the start (small
+    /// writes rely on it). Drives are zeroed one after another, in calls of CREATE_ZERO_SECTORS sectors.
+    /// @param dev TBlkDev interface
+    /// @param config RAID options (chunk size, journal size, parity & hot spare drives)
+    /// @return False if failed, true if succeeded
+    static bool create(const TBlkDev &dev, const CRaidConfig &config = {});
+
+    /// Assembles the RAID from metadata of its drives
+    /// A degraded RAID with hot spares starts rebuilding in the background, missing drives are replaced by spares
+    /// @param dev TBlkDev interface
+    /// @param options runtime options (write-back cache)
+    /// @return int, RAID status
+    int start(const TBlkDev &dev, const CRaidOptions &options = {});
+
+    /// 
+    /// @return 
+    int stop();
+
+    /// Resynchronizes drives in case of RAID_DEGRADED
+    /// Waits for a running background resync (or hot spare rebuild) instead of starting another one
+    /// @return int, RAID status
+    int resync();
+
+    /// Starts resynchronization of drives in a background thread, read() and write() keep working meanwhile
+    /// Rows below the rebuild watermark are served from the replaced drive, rows above it from parity
+    /// @return int, RAID status
+    int resync_async();
+
+    /// Verifies parity of all stripe rows of a RAID_OK volume, read() and write() keep working meanwhile
+    /// Rows are read in batches of whole stripes with one device call per drive, a mismatching row gets parity
+    /// (P & Q with dual parity) calculated from its data if repairing
+    /// @param result out, numbers of checked, mismatching & repaired rows
+    /// @param options in, repair & throughput ceiling
+    /// @return int, RAID status
+    int scrub(CScrubResult &result, const CScrubOptions &options = {});
+
+    /// Grows the RAID onto drives added to TBlkDev, read() and write() keep working meanwhile
+    /// Data is restriped batch by batch onto all member drives behind a persisted checkpoint, stripes below it use
+    /// the grown layout & the others the old one. size() grows once all stripes are restriped. A reshape interrupted
+    /// by a drive failure or stop() continues by calling reshape() with the same drives on a RAID_OK volume.
+    /// Has to return before stop(), a CDriveIoBackend passed to start() has to serve the added drives as well
+    /// @param dev in, TBlkDev interface, drives beyond the current ones become member drives (hot spares stay the
+    /// last drive indices), m_Sectors has to match
+    /// @return bool, reshape finished
+    bool reshape(const TBlkDev &dev);
+
+    /// Returns progress of a reshape
+    /// @return int, percentage of restriped stripes (0-100), -1 if no reshape is in progress
+    int reshape_progress() const;
+
+    /// Copies I/O statistics counted since start() or reset_stats()
+    /// @param stats out, per drive counters & call latencies, path counters & request latencies
+    void stats(CRaidStats &stats) const;
+
+    /// Clears all I/O statistics
+    void reset_stats();
+
+    /// Returns progress of a running resync
+    /// @return int, percentage of rebuilt rows (0-100), -1 if no resync is running
+    int resync_progress() const;
+
+    /// Returns current RAID status
+    /// @return int, RAID status
+    int status() const;
+
+    /// Returns size of usable raid sectors
+    /// \return int, number of usable sectors
+    int size() const;
+
+    /// Reads secCnt sectors to data starting from a given raid sector index (secNr)
+    /// Safe to call concurrently with read() & write(), stripes being read are locked shared
+    /// \param secNr starting raid sector index
+    /// \param data memory to write data to
+    /// \param secCnt number of sectors to read
+    /// \return bool, operation success
+    bool read(int secNr, void *data, int secCnt);
+
+    /// Writes secCnt sectors from data starting from a given raid sector index (secNr)
+    /// Safe to call concurrently with read() & write(), each stripe is locked exclusively while written
+    /// \param secNr starting raid sector index
+    /// \param data memory to read (write) data from
+    /// \param secCnt number of sectors to write
+    /// \return bool, operation success
+    bool write(int secNr, const void *data, int secCnt);
+
+    /// Reads extents scattered over the volume
+    /// Extents are sorted and their drive sectors merged into runs per drive, a batch of extents costs about one
+    /// device call per drive. Safe to call concurrently with read() & write(), stripes of a batch are locked shared.
+    /// \param extents extents to read into their m_data
+    /// \param extent_cnt number of extents
+    /// \return bool, operation success
+    bool readv(const CRaidExtent *extents, int extent_cnt);
+
+    /// Writes extents scattered over the volume
+    /// Adjacent extents are merged & extents are sorted, partial rows of a batch are updated with one batch of reads
+    /// and one batch of writes. Of overlapping extents the later one in extents is written last.
+    /// \param extents extents to write from their m_data
+    /// \param extent_cnt number of extents
+    /// \return bool, operation success
+    bool writev(const CRaidExtent *extents, int extent_cnt);
+
+    /// Submits a read of secCnt sectors starting at secNr, returns immediately
+    /// Requests run concurrently, order of overlapping requests is not defined
+    /// \param secNr starting raid sector index
+    /// \param data memory to write data to, has to stay valid until completion
+    /// \param secCnt number of sectors to read
+    /// \param callback called on completion (before the future is ready), may be empty
+    /// \return future<bool>, operation success
+    future<bool> submit_read(int secNr, void *data, int secCnt, TRaidCallback callback = nullptr);
+
+    /// Submits a write of secCnt sectors starting at secNr, returns immediately
+    /// Requests run concurrently, order of overlapping requests is not defined
+    /// \param secNr starting raid sector index
+    /// \param data memory to read (write) data from, has to stay valid until completion
+    /// \param secCnt number of sectors to write
+    /// \param callback called on completion (before the future is ready), may be empty
+    /// \return future<bool>, operation success
+    future<bool> submit_write(int secNr, const void *data, int secCnt, TRaidCallback callback = nullptr);
+
+    /// Writes all stripes of the write-back cache to drives
+    /// @return bool, all stripes were written
+    bool flush();
+
+    /// Returns number of submitted requests in flight
+    /// @return int, number of requests not completed yet
+    int poll() const;
+
+    /// Waits until all submitted requests completed
+    void wait_all();
+
+protected:
+    /// Executes a read or write request, read()/write() run it on the calling thread, submitted requests on
+    /// an executor thread
+    /// @param request in, request to execute
+    /// @return bool, operation success
+    bool execute_request(const CRaidRequest &request);
+
+    /// Queues a request to the request executor
+    /// @param request in, request to execute
+    /// @param callback in, completion callback, may be empty
+    /// @return future<bool>, operation success
+    future<bool> submit_request(const CRaidRequest &request, TRaidCallback callback);
+
+    /// Reads raid sectors, see read()
+    bool read_sectors(int secNr, void *data, int secCnt);
+
+    /// Writes raid sectors, see write()
+    bool write_sectors(int secNr, const void *data, int secCnt);
+
+    /// Writes part of a stripe to drives, repeats the write in degraded state after a drive failure
+    /// Caller holds the stripe lock exclusively
+    /// @param data in, sector_cnt sectors of raid data
+    /// @param raid_sector in, index of first raid sector to write
+    /// @param sector_cnt in, number of sectors to write, must not cross the stripe end
+    /// @return bool, false if the RAID failed
+    bool write_through(const int *data, int raid_sector, int sector_cnt);
+
+    /// Writes parts of stripes to drives, see write_through()
+    /// Caller holds the stripe locks exclusively, writes are journaled in groups fitting into one transaction
+    /// @param writes in, parts of distinct sectors
+    /// @param write_cnt in, number of parts
+    /// @return bool, false if the RAID failed
+    bool write_through(const CStripeWrite *writes, int write_cnt);
+
+    /// Flushes least recently written stripes until keep_stripe_i fits into the write-back cache
+    /// No stripe lock may be held by the caller
+    /// @param keep_stripe_i in, index of stripe about to be written
+    /// @return bool, false if a flush failed
+    bool evict_write_cache(int keep_stripe_i);
+
+    /// Writes all stripes of the write-back cache to drives, see flush()
+    /// @return bool, all stripes were written
+    bool flush_write_cache();
+
+    /// Writes a stripe of the write-back cache to drives & removes it from the cache
+    /// A completely written stripe takes the full-stripe path, otherwise each written run is written
+    /// Caller holds the stripe lock exclusively
+    /// @param stripe_i in, index of stripe
+    /// @return bool, false if the RAID failed
+    bool flush_stripe(int stripe_i);
+
+    /// Records stripe writes in the write journal before they're applied to the stripes
+    /// Writes queued by concurrent threads are committed together in one transaction (group commit), the first
+    /// waiting thread writes the transaction while the others queue up for the next one
+    /// @param writes in, stripe writes, all of them go into one transaction, so they must not exceed
+    /// JOURNAL_MAX_ENTRIES writes & m_journal_sectors - 1 sectors, none for a checkpoint
+    /// @param write_cnt in, number of writes
+    /// @param seq out, sequence number of the transaction, has to be passed to journal_applied on success
+    /// @return bool, false if the RAID failed
+    bool journal_commit(const CStripeWrite *writes, int write_cnt, int &seq);
+
+    /// Writes queued commits as one transaction to the first JOURNAL_COPY_CNT OK drives
+    /// Called by the committing thread, m_journal_mutex is released while drives are written
+    /// @param journal_lock in, lock of m_journal_mutex
+    void journal_write_txn(unique_lock<mutex> &journal_lock);
+
+    /// Marks a commit of a transaction as applied, journal sectors of transactions are reused once all their
+    /// commits and the commits of older transactions are applied
+    /// @param seq in, sequence number returned by journal_commit
+    void journal_applied(int seq);
+
+    /// Applies transactions not known to be applied from the journal areas of all drives
+    /// Every stripe of an entry is rewritten as a whole, so its parity matches its data again
+    /// @return bool, false if the RAID failed
+    bool journal_replay();
+
+    /// Checks if a journal transaction is complete
+    /// @param txn in, transaction header followed by its data sectors
+    /// @param sector_cnt in, number of sectors available from txn
+    /// @return bool, header is valid & checksum matches
+    static bool journal_txn_valid(const int *txn, int sector_cnt);
+
+    /// Checks tblkdev validity
+    /// @param dev tblkdev instance
+    /// @return bool, validity of dev
+    static bool validate_t_blk_dev(const TBlkDev &dev);
+
+    /// Writes part of a stripe, marks written degraded rows in the write-intent bitmap first
+    /// @param data in, sector_cnt sectors of raid data
+    /// @param raid_sector in, index of first raid sector to write
+    /// @param sector_cnt in, number of sectors to write, must not cross the stripe end
+    /// @return int, index of drive that failed reading/writing, -1 on success
+    int write_stripe(const int *data, int raid_sector, int sector_cnt);
+
+    /// Writes whole consecutive stripes, parity (P & Q if dual parity) is calculated from stripe_data only (no drive
+    /// reads). Every drive is written once with the rows of all stripes, failed drives of the stripes are skipped
+    /// @param stripe_data in, stripe_sector_cnt() sectors of raid data of each stripe
+    /// @param stripe_i in, index of first stripe
+    /// @param stripe_cnt in, number of stripes, all of them in one layout
+    /// @return int, index of drive that failed writing, -1 on success
+    int write_full_stripes(const int *stripe_data, int stripe_i, int stripe_cnt = 1) const;
+
+    /// Writes parts of stripe rows and updates their parity, rows of a single parity RAID must not have a failed drive
+    /// Chooses read-modify-write (read old data + old parity, delta update of P & Q) or reconstruct-write (read
+    /// untouched data) per row based on which needs fewer drive reads. Untouched data of failed drives (dual parity)
+    /// is reconstructed from all readable sectors of its row. Reads of all rows are done before the first write,
+    /// consecutive rows of a drive are read & written with one device call.
+    /// @param rows in, new sectors of the rows
+    /// @return int, index of drive that failed reading/writing, -1 on success
+    int write_partial_rows(const TRowWrites &rows) const;
+
+    /// Adds sectors of part of a stripe to the rows they belong to
+    /// @param data in, sector_cnt sectors of raid data
+    /// @param raid_sector in, index of first raid sector
+    /// @param sector_cnt in, number of sectors, must not cross the stripe end
+    /// @param rows in/out, row writes
+    void add_stripe_rows(const int *data, int raid_sector, int sector_cnt, TRowWrites &rows) const;
+
+    /// Writes parts of stripes, partial rows of stripes without a failed drive are written together
+    /// Caller holds the stripe locks exclusively
+    /// @param writes in, parts of distinct sectors, each must not cross a stripe end
+    /// @param write_cnt in, number of parts
+    /// @return int, index of drive that failed reading/writing, -1 on success
+    int write_stripes(const CStripeWrite *writes, int write_cnt);
+
+    /// Validates & sorts extents by raid sector, then calls batch_func for batches of consecutive extents of at
+    /// most VECTOR_BATCH_SECTORS sectors (a larger extent is a batch of its own). Overlapping extents always share a
+    /// batch, whatever its size.
+    /// @param extents in, extents
+    /// @param extent_cnt in, number of extents
+    /// @param batch_func in, called with sorted extents of a batch & their count, returns success
+    /// @return bool, all extents are valid & all batches succeeded
+    bool for_each_extent_batch(const CRaidExtent *extents, int extent_cnt,
+                               const function<bool(const CRaidExtent *const *, int)> &batch_func) const;
+
+    /// Reads a batch of sorted extents, see readv()
+    bool read_extents(const CRaidExtent *const *extents, int extent_cnt);
+
+    /// Writes a batch of sorted extents, see writev()
+    bool write_extents(const CRaidExtent *const *extents, int extent_cnt);
+
+    /// Writes a single raid sector of a row with a failed drive of a single parity RAID, keeping parity consistent
+    /// @param data in, new sector data
+    /// @param raid_sector in, index of raid sector
+    /// @param failed_drive_i in, failed drive of the row
+    /// @return int, index of drive that failed reading/writing, -1 on success
+    int write_degraded_sector(const int *data, int raid_sector, int failed_drive_i) const;
+
+    /// Adds to a path counter of CRaidStats
+    /// @param path_i in, PATH_* counter index
+    /// @param cnt in, amount to add
+    void count_path(int path_i, uint64_t cnt = 1) const;
+
+    /// Counts a finished read/write request
+    /// @param write in, write request
+    /// @param sector_cnt in, number of requested sectors
+    /// @param start in, time the request started
+    void count_request(bool write, uint64_t sector_cnt, const chrono::steady_clock::time_point &start);
+
+    /// Returns index of drive that has to be reconstructed from parity in a stripe row
+    /// Failed drive is served normally in rows already rebuilt by a running resync, drives which aren't members of the
+    /// row layout (added by a reshape in progress) are ignored
+    /// @param sector_i in, index of row drive sector
+    /// @return int, failed drive index (the first one of two with dual parity), -1 if all row drives are OK
+    int failed_drive_at(int sector_i) const;
+
+    /// Checks if a drive has to be reconstructed from parity in a stripe row, see failed_drive_at()
+    /// @param drive_i in, index of drive
+    /// @param sector_i in, index of row drive sector
+    /// @return bool, drive is failed in the row
+    bool drive_failed_at(int drive_i, int sector_i) const;
+
+    /// Checks if a drive is failed, regardless of rows rebuilt by a running resync
+    /// @param drive_i in, index of drive
+    /// @return bool, drive is m_failed_drive_i or m_second_failed_drive_i
+    bool drive_failed(int drive_i) const;
+
+    /// Updates RAID status after an operation on drive_i failed
+    /// RAID_OK -> RAID_DEGRADED, RAID_DEGRADED -> RAID_FAILED (a dual parity RAID stays degraded with a second
+    /// failed drive), a failure of a drive being resynced discards the resync progress instead
+    /// The first failing thread claims m_failed_drive_i (CAS), the status follows once the drive is set
+    /// A degraded RAID with hot spares requests a background rebuild onto a spare
+    /// @param drive_i in, index of failed drive
+    /// @return int, RAID status
+    int fail_drive(int drive_i);
+
+    /// Rebuilds the failed drives row batch by row batch & writes metadata of a resynced RAID
+    /// Locks only the stripes of one batch at a time
+    /// @return int, RAID status
+    int resync_rows();
+
+    /// Runs resync_rows() until no hot spare rebuild is pending, then clears m_resync_running
+    /// Failed drives without a spare are replaced by one before a rebuild, with all stripes locked
+    /// @param requested in, resync()/resync_async() call, failed drives are rebuilt in place at least once
+    /// @return int, RAID status
+    int resync_loop(bool requested);
+
+    /// Requests a background rebuild of the failed drives onto hot spares after a drive failed
+    /// Starts the resync thread unless a running resync picks the request up
+    void request_spare_rebuild();
+
+    /// Swaps a failed drive with an unused hot spare, the spare is rebuilt from scratch
+    /// Stripes have to be locked, the failed TBlkDev drive takes the spare drive index & isn't used again
+    /// @param drive_i in, index of failed drive
+    /// @return bool, a spare took the place of the drive
+    bool replace_with_spare(int drive_i);
+
+    /// Cancels & joins a running background resync, no resync starts until the next start()
+    void resync_cancel();
+
+    /// Returns layout of a stripe, stripes below m_reshape_stripe are restriped to the grown layout already
+    /// Caller holds m_layout_mutex, shared at least
+    /// @param stripe_i in, index of stripe (the rows of a stripe are the same in both layouts)
+    /// @return const CRaidGeometry &, m_geometry or m_reshape_geometry
+    const CRaidGeometry &stripe_geometry(int stripe_i) const;
+
+    /// Returns layout of a stripe row, see stripe_geometry()
+    /// @param sector_i in, index of row drive sector
+    /// @return const CRaidGeometry &, m_geometry or m_reshape_geometry
+    const CRaidGeometry &row_geometry(int sector_i) const;
+
+    /// Returns end of the rows served by the layout of a stripe row, row batches must not cross it
+    /// @param sector_i in, index of row drive sector
+    /// @return int, index of the first row served by the other layout or m_row_cnt
+    int row_layout_end(int sector_i) const;
+
+    /// Returns layout of a raid sector, raid sectors below m_reshape_sector are restriped already
+    /// Caller holds m_layout_mutex, shared at least
+    /// @param raid_sector in, index of raid sector
+    /// @param layout_first out, first raid sector served by the layout
+    /// @param layout_end out, end of raid sectors served by the layout, parts of stripes must not cross it
+    /// @return const CRaidGeometry &, m_geometry or m_reshape_geometry
+    const CRaidGeometry &sector_geometry(int raid_sector, int &layout_first, int &layout_end) const;
+
+    /// Returns layout of a raid sector, see sector_geometry()
+    const CRaidGeometry &sector_geometry(int raid_sector) const;
+
+    /// Adds drives of dev as member drives and starts a reshape at stripe 0, m_layout_mutex is held exclusively
+    /// Stripes are served by the old layout until restriped, the write-back cache is flushed & disabled meanwhile
+    /// @param dev in, see reshape()
+    /// @return bool, reshape started
+    bool reshape_begin(const TBlkDev &dev);
+
+    /// Restripes the next batch of stripes & persists the checkpoint past it, m_layout_mutex is held exclusively
+    /// Rows of a batch must not hold data which isn't restriped yet, the first stripes (whose rows do) are
+    /// restriped one by one with a copy of their data in the backup area
+    /// @return bool, false if the RAID failed
+    bool reshape_batch();
+
+    /// Restripes the stripe whose restripe was interrupted from its copy in the backup area, called by start()
+    /// @return bool, false if the RAID failed
+    bool reshape_restore_backup();
+
+    /// Writes restriped stripes & moves the checkpoint past them in memory, drives failing meanwhile are failed & the
+    /// stripes are written again degraded
+    /// @param stripe_data in, stripe_sector_cnt() sectors of raid data of each stripe
+    /// @param stripe_i in, index of first stripe
+    /// @param stripe_cnt in, number of stripes
+    /// @return bool, false if the RAID failed
+    bool reshape_write_stripes(const int *stripe_data, int stripe_i, int stripe_cnt);
+
+    /// Ends a reshape of completely restriped stripes, the RAID grows to the size of the grown layout
+    /// m_layout_mutex is held exclusively
+    void reshape_finish();
+
+    /// Plans device calls of the reshape backup area, rows of the added drives no stripe uses while stripes are
+    /// restriped with a backup. The copy is spread over the added drives.
+    /// @param data in/out, m_geometry.stripe_sector_cnt() sectors
+    /// @param write in, write (or read) the copy
+    /// @param ios out, one device call per added drive
+    /// @return int, number of device calls
+    int reshape_backup_ios(int *data, bool write, CDriveIo ios[MAX_RAID_DEVICES]) const;
+
+    /// Returns first row of the reshape backup area, past the rows of stripes restriped with a backup
+    /// @return int, index of row drive sector
+    int reshape_backup_row() const;
+
+    /// Writes metadata with the reshape checkpoint & the current failed drives to all drives, hot spares included
+    /// The timestamp is incremented, a member drive which misses the update is failed, a spare isn't used anymore
+    /// @return int, RAID status
+    int write_reshape_metadata();
+
+    /// Marks write-intent bitmap region of a degraded row, newly set bits are written to all OK drives
+    /// @param sector_i in, index of row drive sector
+    /// @return int, index of drive that failed writing the bitmap, -1 on success
+    int bitmap_mark(int sector_i);
+
+    /// Marks write-intent bitmap regions of rows [sector_i, sector_i + sector_cnt), see bitmap_mark()
+    /// @param sector_i in, index of first row drive sector
+    /// @param sector_cnt in, number of rows
+    /// @return int, index of drive that failed writing the bitmap, -1 on success
+    int bitmap_mark_rows(int sector_i, int sector_cnt);
+
+    /// Writes the write-intent bitmap to all OK drives, m_bitmap_mutex has to be held
+    /// @return int, index of drive that failed writing the bitmap, -1 on success
+    int bitmap_write();
+
+    /// Checks if a write-intent bitmap region of rows [sector_i, sector_i + sector_cnt) is marked
+    /// @param sector_i in, index of first row drive sector
+    /// @param sector_cnt in, number of rows
+    /// @return bool, any region is marked
+    bool bitmap_marked(int sector_i, int sector_cnt) const;
+
+    /// Reads write-intent bitmap from the first readable OK drive, marks every region if none is readable
+    void load_bitmap();
+
+    /// Checks if the failed drives are returning members which still hold data outside of marked regions
+    /// (their metadata is readable and not older than the session in which the first one failed)
+    /// @return bool, only marked regions have to be resynced
+    bool bitmap_resync_possible() const;
+
+    /// Loads metadata into a metadata sector buffer
+    /// @param metadata in, metadata to store
+    /// @param buffer out, metadata sector buffer
+    static void metadata_to_buffer(const CDriveMetadata &metadata, INT_SECTOR_BUFFER(buffer));
+
+    /// Loads metadata from a metadata sector buffer, a superblock is valid if its magic, version & checksum match and
+    /// its drive roles match the rest of it
+    /// @param buffer in, metadata sector buffer
+    /// @param metadata out, stored metadata
+    /// @return bool, superblock is valid
+    static bool metadata_from_buffer(const INT_SECTOR_BUFFER(buffer), CDriveMetadata &metadata);
+
+    /// Returns role of a drive index stored in the superblock
+    /// @param metadata in, metadata of the RAID
+    /// @param drive_i in, index of drive
+    /// @return int, DRIVE_ROLE_*
+    static int drive_role(const CDriveMetadata &metadata, int drive_i);
+
+    /// Reads superblocks of all TBlkDev drives in parallel, drive indices have to be mapped to themselves
+    /// @param metadata out, superblock of each TBlkDev drive
+    /// @param valid out, superblock of the drive was read & is valid
+    void read_superblocks(CDriveMetadata metadata[MAX_RAID_DEVICES], bool valid[MAX_RAID_DEVICES]);
+
+    /// Picks the superblock to assemble the RAID from, the generation (timestamp) most drives of the array most
+    /// drives belong to agree on, the newer one on a tie
+    /// A newer superblock knowing other failed drives wins over the majority, the newest one is picked then
+    /// @param metadata in, superblock of each TBlkDev drive
+    /// @param valid in, superblock of the drive is valid
+    /// @param device_cnt in, number of TBlkDev drives
+    /// @return int, index of TBlkDev drive holding the superblock, -1 if no superblock is valid
+    static int assembly_superblock(const CDriveMetadata *metadata, const bool *valid, int device_cnt);
+
+    /// Checks superblocks of one array for the same drive assignment & failures, they differ in checkpoints only
+    /// @param first in, superblock
+    /// @param second in, superblock
+    /// @return bool, drive roles & TBlkDev drives of drive indices match
+    static bool same_drive_state(const CDriveMetadata &first, const CDriveMetadata &second);
+
+    /// Checks a superblock for a reshape begun after another superblock of the array, no data is restriped yet
+    /// Drives which missed the begin of a reshape only miss the added drives & hold all data
+    /// @param before in, older superblock
+    /// @param after in, newer superblock
+    /// @return bool, after only adds drives to the drives of before
+    static bool reshape_begun(const CDriveMetadata &before, const CDriveMetadata &after);
+
+    /// Clears & resets all member variables to default
+    /// (frees m_dev ptr)
+    void clear_raid_volume_data();
+
+    /// Returns a sector of a stripe row, a sector of a drive failed in the row is reconstructed from the other
+    /// drives of the row (read in parallel), a sector of an OK drive is read
+    /// @param out_buffer out, int buffer of SECTOR_SIZE Bytes
+    /// @param drive_i in, index of drive
+    /// @param sector_i in, index of row drive sector
+    /// @return int, index of drive that failed reading, -1 on success
+    int reconstruct_sector(INT_SECTOR_BUFFER(out_buffer), int drive_i, int sector_i) const;
+
+    /// Returns data or parity by xoring sectors from other drives.
+    /// @param out_buffer out, int buffer of SECTOR_SIZE Bytes
+    /// @param dead_drive_i in, index of faulty drive
+    /// @param sector_i in, index of faulty drive sector
+    /// @return bool, reading success
+    int xor_read_without_sector(INT_SECTOR_BUFFER(out_buffer), int dead_drive_i, int sector_i) const;
+
+    int xor_get_parity_supplement_dead_sector(INT_SECTOR_BUFFER(out_buffer), int parity_drive_i,
+                                              int dead_drive_i,
+                                              const INT_SECTOR_BUFFER(dead_drive_supplement_buffer),
+                                              int sector_i) const;
+
+    // Tblkdev interface ptr
+    TBlkDev *m_dev = nullptr;
+    // Metadata sector index & metadata ptr
+    int m_metadata_sector = 0;
+    CDriveMetadata m_metadata = {};
+    // Number of stripe rows (data & parity sectors per drive), a multiple of the chunk size
+    int m_row_cnt = 0;
+    // Stripe layout of all member drives, only restriped stripes use it while a reshape is in progress
+    CRaidGeometry m_geometry;
+    // Online reshape, stripes below m_reshape_stripe (their raid sectors are those below m_reshape_sector) use
+    // m_geometry & the others the layout before the reshape, m_reshape_geometry. Both are past all stripes (raid
+    // sectors) if no reshape is in progress.
+    CRaidGeometry m_reshape_geometry;
+    atomic<int> m_reshape_stripe = 0;
+    int m_reshape_sector = 0;
+    // Layouts change only while held exclusively, requests, resync & scrub batches hold it shared
+    mutable shared_mutex m_layout_mutex;
+    // Write-intent bitmap sector index, bitmap of regions written while RAID_DEGRADED & region size in rows
+    int m_bitmap_sector = 0;
+    unsigned char m_bitmap[SECTOR_SIZE] = {};
+    int m_bitmap_region_rows = 1;
+    mutable mutex m_bitmap_mutex;
+    // Current RAID status & failed drive index (-1 if none), m_metadata.m_failed_drive_i is only its stored copy
+    // A dual parity RAID stays degraded with a second failed drive, set only while m_failed_drive_i is set
+    atomic<int> m_status = RAID_STOPPED;
+    atomic<int> m_failed_drive_i = -1;
+    atomic<int> m_second_failed_drive_i = -1;
+    // Current RAID size
+    atomic<int> m_raid_size = 0;
+    // Member R/W buffer
+    INT_SECTOR_BUFFER(m_buffer);
+    // Stripe locks of read(), write() & resync row batches
+    CStripeLockTable m_stripe_locks;
+    // Issues device calls of a row/batch to all drives in parallel, used by const methods as well
+    mutable CDriveIoEngine m_io_engine;
+    // Work of the read & write paths, see CRaidStats
+    mutable atomic<uint64_t> m_path_counters[PATH_COUNTER_CNT] = {};
+    CLatencyRecorder m_read_latency;
+    CLatencyRecorder m_write_latency;
+    atomic<uint64_t> m_requested_read_sectors{0};
+    atomic<uint64_t> m_requested_write_sectors{0};
+    // Executes submitted requests
+    CRequestExecutor m_request_executor;
+    // Failed drive sectors reconstructed by read(), rows are invalidated by writes & the failed drive changing
+    CRowCache m_row_cache{ROW_CACHE_ROWS};
+    // Dirty stripes not written to drives yet, disabled unless CRaidOptions::m_write_back_stripes is set & while a
+    // reshape is in progress
+    CStripeWriteCache m_write_cache;
+    int m_write_back_stripes = 0;
+    // Write journal area [m_journal_first_sector, m_bitmap_sector) of each drive, stripe writes are recorded there
+    // before they're applied while m_journal_active is set
+    int m_journal_first_sector = 0;
+    int m_journal_sectors = 0;
+    bool m_journal_active = false;
+    // Group commit state, entries waiting for a transaction & transactions whose sectors can't be reused yet
+    mutex m_journal_mutex;
+    condition_variable m_journal_cv;
+    deque<CJournalCommit *> m_journal_queue;
+    deque<CJournalTxn> m_journal_txns;
+    bool m_journal_committing = false;
+    int m_journal_seq = 0;
+    int m_journal_head = 0;
+    // Resync thread, rows below watermark are rebuilt on the failed drive
+    thread m_resync_thread;
+    atomic<int> m_resync_watermark = 0;
+    atomic<bool> m_resync_running = false;
+    atomic<bool> m_resync_cancel = false;
+    // Guards starting & finishing of resyncs & hot spare replacement, m_resync_done is notified when none runs
+    mutex m_resync_mutex;
+    condition_variable m_resync_done;
+    // A failure requested a rebuild onto hot spares & bits of failed drives rebuilt by it (a spare took their place
+    // or they are rebuilt in place after start)
+    bool m_spare_rebuild_pending = false;
+    unsigned m_spare_rebuild_drives = 0;
+};
+
+CRaidVolume::CRaidVolume() {
+    clear_raid_volume_data();
+}
+
+CRaidVolume::~CRaidVolume() {
+    resync_cancel();
+    clear_raid_volume_data();
+}
+
+bool CRaidVolume::create(const TBlkDev &dev, const CRaidConfig &config) {
+    if (!validate_t_blk_dev(dev))
+        return false;
+    if (config.m_chunk_sectors < 1 || config.m_chunk_sectors > MAX_CHUNK_SECTORS
+        || config.m_chunk_sectors > dev.m_Sectors - 2)
+        return false;
+    // Stripes span all drives except for the hot spares
+    const int member_cnt = dev.m_Devices - config.m_spare_cnt;
+    if (config.m_parity_cnt < 1 || config.m_parity_cnt > 2 || config.m_spare_cnt < 0
+        || member_cnt < (config.m_parity_cnt == 2 ? MIN_RAID6_DEVICES : MIN_RAID_DEVICES))
+        return false;
+    // Journal has to hold a header & a whole stripe and leave at least one stripe for data
+    if (config.m_journal_sectors < 0 || config.m_journal_sectors > dev.m_Sectors - 2 - config.m_chunk_sectors)
+        return false;
+    if (config.m_journal_sectors > 0
+        && config.m_journal_sectors <= config.m_chunk_sectors * (member_cnt - config.m_parity_cnt))
+        return false;
+
+    // Check if sector_size is too small for metadata
+    if constexpr (SECTOR_SIZE < METADATA_INT_CNT * sizeof(int))
+        return false;
+
+    // Create stack int buffers
+    INT_SECTOR_BUFFER(buffer);
+    INT_SECTOR_BUFFER(bitmap_buffer) = {};
+    CDriveMetadata metadata(-1, 0);
+    metadata.m_chunk_sectors = config.m_chunk_sectors;
+    metadata.m_journal_sectors = config.m_journal_sectors;
+    metadata.m_parity_cnt = config.m_parity_cnt;
+    metadata.m_spare_cnt = config.m_spare_cnt;
+    metadata.m_device_cnt = dev.m_Devices;
+    metadata.m_sector_cnt = dev.m_Sectors;
+    for (int drive_i = 0; drive_i < dev.m_Devices; drive_i++)
+        metadata.m_drive_devices[drive_i] = drive_i;
+    // UUID tells drives of this RAID from drives of other RAIDs
+    random_device random;
+    mt19937 uuid_generator(random() ^ static_cast<unsigned>(chrono::steady_clock::now().time_since_epoch().count()));
+    for (int &uuid_part : metadata.m_uuid)
+        uuid_part = static_cast<int>(uuid_generator());
+    metadata_to_buffer(metadata, buffer);
+
+    // Try write zeroed rows, empty journal, empty write-intent bitmap & default metadata to all drives, hot spares
+    // included. Zeroed rows have zero parity, read-modify-write of small writes relies on parity matching the data.
+    const int metadata_sector_i = dev.m_Sectors - 1;
+    const int bitmap_sector_i = dev.m_Sectors - 2;
+    const vector<int> zero_buffer(CREATE_ZERO_SECTORS * (SECTOR_SIZE / sizeof(int)));
+    for (int dev_i = 0; dev_i < dev.m_Devices; dev_i++) {
+        for (int sector_i = 0; sector_i < bitmap_sector_i; sector_i += CREATE_ZERO_SECTORS) {
+            const int sector_cnt = min(CREATE_ZERO_SECTORS, bitmap_sector_i - sector_i);
+            if (dev.m_Write(dev_i, sector_i, zero_buffer.data(), sector_cnt) != sector_cnt)
+                return false;
+        }
+        if (dev.m_Write(dev_i, bitmap_sector_i, &bitmap_buffer, 1) != 1)
+            return false;
+        if (dev.m_Write(dev_i, metadata_sector_i, &buffer, 1) != 1)
+            return false;
+    }
+
+    return true;
+}
+
+int CRaidVolume::start(const TBlkDev &dev, const CRaidOptions &options) {
+    // RAID volume was not stopped before calling start
+    if (m_dev != nullptr || !validate_t_blk_dev(dev))
+        return RAID_FAILED;
+
+    // Initialize RAID, Copy TBlkDev
+    m_dev = new TBlkDev;
+    m_dev->m_Devices = dev.m_Devices;
+    m_dev->m_Sectors = dev.m_Sectors;
+    m_dev->m_Read = dev.m_Read;
+    m_dev->m_Write = dev.m_Write;
+
+    // Assume RAID_OK before checking metadata
+    m_status = RAID_OK;
+    // Initialize metadata & bitmap sector
+    m_metadata_sector = m_dev->m_Sectors - 1;
+    m_bitmap_sector = m_dev->m_Sectors - 2;
+    memset(m_bitmap, 0, SECTOR_SIZE);
+
+    // Metadata read buffer
+    INT_SECTOR_BUFFER(read_buffer);
+
+    // Load superblocks of all drives, a drive without a valid superblock is handled like an unreadable one
+    CDriveMetadata drive_metadata[MAX_RAID_DEVICES];
+    bool readable[MAX_RAID_DEVICES] = {};
+    m_io_engine.start(*m_dev, options.m_io_backend);
+    read_superblocks(drive_metadata, readable);
+    const int assembly_drive = assembly_superblock(drive_metadata, readable, m_dev->m_Devices);
+
+    // None of the drives is readable
+    if (assembly_drive < 0) {
+        m_status = RAID_FAILED;
+        return m_status;
+    }
+
+    // Picked metadata knows every failure, the other drives have to match it or be known as failed
+    // Superblocks of another RAID don't count
+    m_metadata = drive_metadata[assembly_drive];
+    for (int dev_i = 0; dev_i < m_dev->m_Devices; dev_i++)
+        readable[dev_i] = readable[dev_i]
+                          && memcmp(drive_metadata[dev_i].m_uuid, m_metadata.m_uuid, sizeof(m_metadata.m_uuid)) == 0;
+
+    // Superblock describes another drive geometry or layout
+    if (m_metadata.m_device_cnt != m_dev->m_Devices || m_metadata.m_sector_cnt != m_dev->m_Sectors
+        || m_metadata.m_layout != LAYOUT_LEFT_SYMMETRIC) {
+        m_status = RAID_FAILED;
+        return m_status;
+    }
+
+    // Drive index of each TBlkDev drive, every drive has to serve exactly one drive index
+    int device_drives[MAX_RAID_DEVICES];
+    fill(device_drives, device_drives + MAX_RAID_DEVICES, -1);
+    bool devices_valid = m_metadata.m_spare_cnt >= 0 && m_metadata.m_spare_cnt <= m_dev->m_Devices - MIN_RAID_DEVICES;
+    for (int drive_i = 0; devices_valid && drive_i < m_dev->m_Devices; drive_i++) {
+        const int device_i = m_metadata.m_drive_devices[drive_i];
+        devices_valid = device_i >= 0 && device_i < m_dev->m_Devices && device_drives[device_i] < 0;
+        if (devices_valid)
+            device_drives[device_i] = drive_i;
+    }
+    if (!devices_valid) {
+        m_status = RAID_FAILED;
+        return m_status;
+    }
+    const int member_cnt = m_dev->m_Devices - m_metadata.m_spare_cnt;
+
+    for (int dev_i = 0; dev_i < m_dev->m_Devices; dev_i++) {
+        const int drive_i = device_drives[dev_i];
+
+        // Newer superblocks of a drive only differ in checkpoints, see assembly_superblock(). An older one which
+        // only missed generation or checkpoint updates (an interrupted metadata write) or the begin of a reshape
+        // belongs to a drive holding all data as well.
+        const CDriveMetadata &assembly = drive_metadata[assembly_drive];
+        const bool up_to_date =
+            readable[dev_i]
+            && (drive_metadata[dev_i].m_timestamp >= assembly.m_timestamp
+                || ((same_drive_state(drive_metadata[dev_i], assembly)
+                     || reshape_begun(drive_metadata[dev_i], assembly))
+                    && drive_metadata[dev_i].m_timestamp >= assembly.m_degraded_timestamp));
+
+        // Hot spares aren't needed to assemble the RAID, a missing or outdated spare isn't used
+        if (drive_i >= member_cnt) {
+            if (!up_to_date)
+                m_metadata.m_failed_spares |= 1 << drive_i;
+            continue;
+        }
+
+        if (drive_i == m_metadata.m_failed_drive_i || drive_i == m_metadata.m_second_failed_drive_i)
+            continue;
+        if (up_to_date)
+            continue;
+
+        // Drive failed after the last stop or missed a drive state change, a dual parity RAID survives a second
+        // failure
+        if (m_metadata.m_failed_drive_i < 0) {
+            m_metadata.m_failed_drive_i = drive_i;
+            m_metadata.m_degraded_timestamp = m_metadata.m_timestamp;
+        } else if (m_metadata.m_parity_cnt == 2 && m_metadata.m_second_failed_drive_i < 0) {
+            m_metadata.m_second_failed_drive_i = drive_i;
+        } else {
+            m_status = RAID_FAILED;
+            return m_status;
+        }
+    }
+    m_status = m_metadata.m_failed_drive_i < 0 ? RAID_OK : RAID_DEGRADED;
+
+    // Chunk, parity or journal size can't be trusted
+    if (m_metadata.m_chunk_sectors < 1 || m_metadata.m_chunk_sectors > m_dev->m_Sectors - 2
+        || m_metadata.m_parity_cnt < 1 || m_metadata.m_parity_cnt > 2
+        || (m_metadata.m_parity_cnt == 2 && member_cnt < MIN_RAID6_DEVICES)
+        || (m_metadata.m_parity_cnt == 1 && m_metadata.m_second_failed_drive_i >= 0)
+        || m_metadata.m_failed_drive_i >= member_cnt || m_metadata.m_second_failed_drive_i >= member_cnt
+        || m_metadata.m_journal_sectors < 0
+        || m_metadata.m_journal_sectors > m_dev->m_Sectors - 2 - m_metadata.m_chunk_sectors
+        || (m_metadata.m_journal_sectors > 0
+            && m_metadata.m_journal_sectors
+                   <= m_metadata.m_chunk_sectors * (member_cnt - m_metadata.m_parity_cnt))) {
+        m_status = RAID_FAILED;
+        return m_status;
+    }
+
+    // Last two sectors of each drive hold the write-intent bitmap & metadata, the journal precedes them, the rest
+    // are whole stripes of the drives except for hot spares
+    m_geometry = CRaidGeometry(member_cnt, m_metadata.m_chunk_sectors, m_metadata.m_parity_cnt);
+    m_journal_sectors = m_metadata.m_journal_sectors;
+    m_journal_first_sector = m_bitmap_sector - m_journal_sectors;
+    m_row_cnt = m_journal_first_sector / m_geometry.m_chunk_sectors * m_geometry.m_chunk_sectors;
+    // Calculate raid size
+    const int usable_sector_count = m_geometry.m_devices * m_row_cnt; // Number of non metadata sectors
+    // Subtract parity sectors - aka one (two with dual parity) for each line
+    m_raid_size = usable_sector_count - m_geometry.m_parity_cnt * m_row_cnt;
+    m_bitmap_region_rows = (m_row_cnt + BITMAP_REGION_CNT - 1) / BITMAP_REGION_CNT;
+    m_reshape_stripe = m_row_cnt / m_geometry.m_chunk_sectors;
+    m_reshape_sector = m_raid_size;
+
+    // Reshape in progress, stripes past the checkpoint are served by the old layout & the RAID keeps its old size
+    if (m_metadata.m_reshape_devices > 0) {
+        const int stripe_cnt = m_reshape_stripe;
+        m_reshape_geometry = CRaidGeometry(m_metadata.m_reshape_devices, m_metadata.m_chunk_sectors,
+                                           m_metadata.m_parity_cnt);
+        m_raid_size = m_reshape_geometry.data_drive_cnt() * m_row_cnt;
+        m_reshape_stripe = m_metadata.m_reshape_stripe;
+        m_reshape_sector = m_reshape_stripe * m_geometry.stripe_sector_cnt();
+        if (m_metadata.m_reshape_devices < (m_metadata.m_parity_cnt == 2 ? MIN_RAID6_DEVICES : MIN_RAID_DEVICES)
+            || m_metadata.m_reshape_devices >= member_cnt || m_metadata.m_reshape_stripe < 0
+            || m_metadata.m_reshape_stripe > stripe_cnt || m_metadata.m_reshape_backup_stripe < -1
+            || (m_metadata.m_reshape_backup_stripe >= 0
+                && m_metadata.m_reshape_backup_stripe != m_metadata.m_reshape_stripe)) {
+            m_status = RAID_FAILED;
+            return m_status;
+        }
+    }
+
+    m_failed_drive_i = m_metadata.m_failed_drive_i;
+    m_second_failed_drive_i = m_metadata.m_second_failed_drive_i;
+
+    for (int drive_i = 0; drive_i < m_dev->m_Devices; drive_i++)
+        m_io_engine.map_drive(drive_i, m_metadata.m_drive_devices[drive_i]);
+    reset_stats();
+
+    // Load regions written since the drive failed
+    if (m_status == RAID_DEGRADED)
+        load_bitmap();
+
+    // Complete a restripe & stripe writes interrupted by a crash before the RAID is used
+    if (m_metadata.m_reshape_devices > 0 && m_metadata.m_reshape_backup_stripe >= 0 && !reshape_restore_backup())
+        return m_status;
+    if (m_journal_sectors > 0 && !journal_replay())
+        return m_status;
+
+    m_write_back_stripes = max(0, options.m_write_back_stripes);
+    m_write_cache.configure(m_metadata.m_reshape_devices > 0 ? 0 : m_write_back_stripes,
+                            m_geometry.stripe_sector_cnt());
+    m_request_executor.start(REQUEST_WORKER_CNT);
+
+    // Hot spares replace failed drives which are missing, failed drives still readable are rebuilt in place
+    m_resync_cancel = false;
+    if (m_status == RAID_DEGRADED && m_metadata.m_spare_cnt > 0) {
+        {
+            lock_guard<mutex> resync_lock(m_resync_mutex);
+            for (const int failed_drive_i : {m_failed_drive_i.load(), m_second_failed_drive_i.load()})
+                if (failed_drive_i >= 0 && m_io_engine.read(failed_drive_i, m_metadata_sector, read_buffer, 1))
+                    m_spare_rebuild_drives |= 1u << failed_drive_i;
+        }
+        request_spare_rebuild();
+    }
+    return m_status;
+}
+
+int CRaidVolume::stop() {
+    // Complete submitted requests before the final metadata is written
+    m_request_executor.stop();
+    resync_cancel();
+
+    // Write back cached stripes, a failure leaves the RAID failed
+    if (m_status != RAID_STOPPED && m_status != RAID_FAILED)
+        flush();
+
+    // All journaled writes are applied, the next start has nothing to replay
+    if (m_journal_active && m_status != RAID_STOPPED && m_status != RAID_FAILED) {
+        int checkpoint_seq = -1;
+        if (journal_commit(nullptr, 0, checkpoint_seq))
+            journal_applied(checkpoint_seq);
+    }
+    m_journal_active = false;
+
+    if (m_status == RAID_STOPPED || m_status == RAID_FAILED)
+        return m_status = RAID_STOPPED;
+
+    // Store the current failed drives & increment metadata timestamp
+    m_metadata.m_failed_drive_i = m_failed_drive_i;
+    m_metadata.m_second_failed_drive_i = m_second_failed_drive_i;
+    m_metadata.m_timestamp += 1;
+
+    // Load metadata to m_buffer
+    metadata_to_buffer(m_metadata, m_buffer);
+
+    // Write metadata information to all drives, hot spares included
+    for (int dev_i = 0; dev_i < m_dev->m_Devices; dev_i++) {
+        if (m_io_engine.write(dev_i, m_metadata_sector, &m_buffer, 1))
+            continue;
+
+        // Skip trying to correct writing to a degraded drive or a failed RAID
+        if (m_metadata.m_failed_drive_i == dev_i || m_metadata.m_second_failed_drive_i == dev_i)
+            continue;
+
+        // Spare which missed the metadata isn't used anymore, rewrite buffer info
+        if (dev_i >= m_geometry.m_devices) {
+            if (!(m_metadata.m_failed_spares & (1 << dev_i))) {
+                m_metadata.m_failed_spares |= 1 << dev_i;
+                metadata_to_buffer(m_metadata, m_buffer);
+                dev_i = -1;
+            }
+            continue;
+        }
+
+        // Raid degraded while stopping, rewrite buffer info
+        if (m_status == RAID_OK) {
+            m_metadata.m_failed_drive_i = dev_i;
+            // Drive only missed this metadata update, its data is intact
+            m_metadata.m_degraded_timestamp = m_metadata.m_timestamp - 1;
+            m_status = RAID_DEGRADED;
+            metadata_to_buffer(m_metadata, m_buffer);
+            dev_i = -1;
+            continue;
+        }
+
+        // Dual parity RAID survives a second failure while stopping
+        if (m_status == RAID_DEGRADED && m_geometry.m_parity_cnt == 2 && m_metadata.m_second_failed_drive_i < 0) {
+            m_metadata.m_second_failed_drive_i = dev_i;
+            metadata_to_buffer(m_metadata, m_buffer);
+            dev_i = -1;
+            continue;
+        }
+
+        // RAID failed while stopping, rewrite metadata without checking
+        if (m_status == RAID_DEGRADED) {
+            m_status = RAID_FAILED;
+            dev_i = -1;
+        }
+    }
+
+    // Clear CRaidVolume data
+    clear_raid_volume_data();
+
+    return m_status;
+}
+
+int CRaidVolume::resync() {
+    unique_lock<mutex> resync_lock(m_resync_mutex);
+
+    // Background resync is already running, wait for its result
+    if (m_resync_running) {
+        m_resync_done.wait(resync_lock, [this] { return !m_resync_running; });
+        return m_status;
+    }
+
+    if (m_status == RAID_OK || m_status == RAID_FAILED || m_status == RAID_STOPPED)
+        return m_status;
+
+    m_resync_running = true;
+    resync_lock.unlock();
+    return resync_loop(true);
+}
+
+int CRaidVolume::resync_async() {
+    lock_guard<mutex> resync_lock(m_resync_mutex);
+    if (m_resync_running || m_status == RAID_OK || m_status == RAID_FAILED || m_status == RAID_STOPPED)
+        return m_status;
+
+    // Join previous finished resync
+    if (m_resync_thread.joinable())
+        m_resync_thread.join();
+
+    m_resync_running = true;
+    m_resync_cancel = false;
+    m_resync_thread = thread(&CRaidVolume::resync_loop, this, true);
+    return m_status;
+}
+
+int CRaidVolume::scrub(CScrubResult &result, const CScrubOptions &options) {
+    result = {};
+    if (m_status != RAID_OK)
+        return m_status;
+
+    const int chunk_sectors = m_geometry.m_chunk_sectors;
+    const int parity_cnt = m_geometry.m_parity_cnt;
+    const int batch_rows = max(1, SCRUB_BATCH_ROWS / chunk_sectors) * chunk_sectors;
+    // Batch buffers, one run of batch_rows sectors per drive & parity chunks (P, Q) of a stripe calculated from data
+    vector<int> batch_buffer(m_geometry.m_devices * batch_rows * (SECTOR_SIZE / sizeof(int)));
+    vector<int> parity_buffer(parity_cnt * chunk_sectors * (SECTOR_SIZE / sizeof(int)));
+    const void *batch_runs[MAX_RAID_DEVICES];
+    const auto start = chrono::steady_clock::now();
+    long long read_bytes = 0;
+
+    int batch_cnt = 0;
+    for (int batch_i = 0; batch_i < m_row_cnt; batch_i += batch_cnt) {
+        int drive_cnt = 0;
+        {
+            // Batch is verified in one layout, it doesn't cross the restriped stripes of a reshape in progress
+            shared_lock<shared_mutex> layout_lock(m_layout_mutex);
+            const CRaidGeometry &geometry = row_geometry(batch_i);
+            const int data_drive_cnt = geometry.data_drive_cnt();
+            drive_cnt = geometry.m_devices;
+            batch_cnt = min(batch_rows, row_layout_end(batch_i) - batch_i);
+            // Writers of the batch wait, repairs need the stripes exclusively
+            CStripeLockGuard batch_lock(m_stripe_locks, batch_i / chunk_sectors,
+                                        (batch_i + batch_cnt - 1) / chunk_sectors, options.m_repair);
+            // Drive failed meanwhile, parity can't be verified anymore
+            if (m_status != RAID_OK)
+                return m_status;
+
+            // Read row batch of all drives in parallel
+            CDriveIo run_ios[MAX_RAID_DEVICES];
+            for (int drive_i = 0; drive_i < drive_cnt; drive_i++) {
+                int *run_buffer = batch_buffer.data() + drive_i * batch_rows * (SECTOR_SIZE / sizeof(int));
+                run_ios[drive_i].m_drive_i = drive_i;
+                run_ios[drive_i].m_sector_i = batch_i;
+                run_ios[drive_i].m_sector_cnt = batch_cnt;
+                run_ios[drive_i].m_read_buffer = run_buffer;
+                batch_runs[drive_i] = run_buffer;
+            }
+            int failed_drive = -1;
+            if ((failed_drive = m_io_engine.execute(run_ios, drive_cnt)) >= 0)
+                return fail_drive(failed_drive);
+
+            // Parity of each stripe is calculated from its data chunks (runs of chunk_sectors rows) in one pass
+            for (int stripe_row = 0; stripe_row < batch_cnt; stripe_row += chunk_sectors) {
+                int drives[MAX_RAID_DEVICES];
+                geometry.stripe_drives_of(batch_i + stripe_row, drives);
+                const void *chunks[MAX_RAID_DEVICES];
+                for (int chunk_i = 0; chunk_i < data_drive_cnt; chunk_i++)
+                    chunks[chunk_i] = static_cast<const char *>(batch_runs[drives[chunk_i]]) + stripe_row * SECTOR_SIZE;
+                int *q_chunk = parity_buffer.data() + (parity_cnt - 1) * chunk_sectors * (SECTOR_SIZE / sizeof(int));
+                if (parity_cnt == 2)
+                    CGfKernel::gen_syndrome(parity_buffer.data(), q_chunk, chunks, data_drive_cnt,
+                                            chunk_sectors * SECTOR_SIZE);
+                else {
+                    memset(parity_buffer.data(), 0, chunk_sectors * SECTOR_SIZE);
+                    CXorKernel::xor_blocks(parity_buffer.data(), chunks, data_drive_cnt, chunk_sectors * SECTOR_SIZE);
+                }
+
+                for (int row_offset = 0; row_offset < chunk_sectors; row_offset++) {
+                    const int sector_i = batch_i + stripe_row + row_offset;
+                    bool mismatch = false;
+                    for (int parity_i = 0; parity_i < parity_cnt; parity_i++) {
+                        const int parity_drive_i = drives[data_drive_cnt + parity_i];
+                        const int *parity = parity_buffer.data()
+                                            + (parity_i * chunk_sectors + row_offset) * (SECTOR_SIZE / sizeof(int));
+                        const void *old_parity = static_cast<const char *>(batch_runs[parity_drive_i])
+                                                 + (stripe_row + row_offset) * SECTOR_SIZE;
+                        if (memcmp(parity, old_parity, SECTOR_SIZE) == 0)
+                            continue;
+                        mismatch = true;
+                        // Parity calculated from the row data replaces the stored one
+                        if (options.m_repair && !m_io_engine.write(parity_drive_i, sector_i, parity, 1))
+                            return fail_drive(parity_drive_i);
+                    }
+                    if (!mismatch)
+                        continue;
+                    result.m_mismatch_rows++;
+                    if (options.m_repair)
+                        result.m_repaired_rows++;
+                }
+            }
+            result.m_checked_rows += batch_cnt;
+        }
+
+        // Sleep until the average read rate drops to the ceiling, foreground I/O gets the drives meanwhile
+        read_bytes += static_cast<long long>(batch_cnt) * drive_cnt * SECTOR_SIZE;
+        if (options.m_max_mb_per_sec > 0)
+            this_thread::sleep_until(start + chrono::microseconds(read_bytes / options.m_max_mb_per_sec));
+    }
+
+    return m_status;
+}
+
+int CRaidVolume::resync_progress() const {
+    if (!m_resync_running)
+        return -1;
+    return static_cast<int>(100LL * m_resync_watermark / m_row_cnt);
+}
+
+bool CRaidVolume::reshape(const TBlkDev &dev) {
+    {
+        unique_lock<shared_mutex> layout_lock(m_layout_mutex);
+        if (m_status != RAID_OK)
+            return false;
+        // Reshape in progress continues with the drives it started with
+        if (m_metadata.m_reshape_devices > 0) {
+            if (dev.m_Devices != m_dev->m_Devices || dev.m_Sectors != m_dev->m_Sectors)
+                return false;
+        } else if (!reshape_begin(dev))
+            return false;
+    }
+
+    // Requests waiting for the layout run between batches
+    while (true) {
+        unique_lock<shared_mutex> layout_lock(m_layout_mutex);
+        if (m_reshape_stripe >= m_row_cnt / m_geometry.m_chunk_sectors) {
+            reshape_finish();
+            return m_status != RAID_FAILED;
+        }
+        if (!reshape_batch())
+            return false;
+    }
+}
+
+int CRaidVolume::reshape_progress() const {
+    shared_lock<shared_mutex> layout_lock(m_layout_mutex);
+    if (m_status == RAID_STOPPED || m_metadata.m_reshape_devices == 0)
+        return -1;
+    const int stripe_cnt = m_row_cnt / m_geometry.m_chunk_sectors;
+    return static_cast<int>(100LL * m_reshape_stripe / stripe_cnt);
+}
+
+int CRaidVolume::status() const {
+    return m_status;
+}
+
+void CRaidVolume::stats(CRaidStats &stats) const {
+    m_io_engine.stats(stats);
+    for (int path_i = 0; path_i < PATH_COUNTER_CNT; path_i++)
+        stats.m_paths[path_i] = m_path_counters[path_i].load(memory_order_relaxed);
+    m_read_latency.snapshot(stats.m_read_latency);
+    m_write_latency.snapshot(stats.m_write_latency);
+    stats.m_requested_read_sectors = m_requested_read_sectors.load(memory_order_relaxed);
+    stats.m_requested_write_sectors = m_requested_write_sectors.load(memory_order_relaxed);
+}
+
+void CRaidVolume::reset_stats() {
+    m_io_engine.reset_stats();
+    for (atomic<uint64_t> &counter : m_path_counters)
+        counter.store(0, memory_order_relaxed);
+    m_read_latency.reset();
+    m_write_latency.reset();
+    m_requested_read_sectors.store(0, memory_order_relaxed);
+    m_requested_write_sectors.store(0, memory_order_relaxed);
+}
+
+void CRaidVolume::count_path(const int path_i, const uint64_t cnt) const {
+    m_path_counters[path_i].fetch_add(cnt, memory_order_relaxed);
+}
+
+void CRaidVolume::count_request(const bool write, const uint64_t sector_cnt,
+                                const chrono::steady_clock::time_point &start) {
+    (write ? m_write_latency : m_read_latency).record(elapsed_us(start));
+    (write ? m_requested_write_sectors : m_requested_read_sectors).fetch_add(sector_cnt, memory_order_relaxed);
+}
+
+int CRaidVolume::size() const {
+    return m_raid_size;
+}
+
+bool CRaidVolume::read(int secNr, void *data, int secCnt) {
+    CRaidRequest request;
+    request.m_sector_i = secNr;
+    request.m_sector_cnt = secCnt;
+    request.m_read_data = data;
+    return execute_request(request);
+}
+
+bool CRaidVolume::write(int secNr, const void *data, int secCnt) {
+    CRaidRequest request;
+    request.m_sector_i = secNr;
+    request.m_sector_cnt = secCnt;
+    request.m_write_data = data;
+    return execute_request(request);
+}
+
+future<bool> CRaidVolume::submit_read(int secNr, void *data, int secCnt, TRaidCallback callback) {
+    CRaidRequest request;
+    request.m_sector_i = secNr;
+    request.m_sector_cnt = secCnt;
+    request.m_read_data = data;
+    return submit_request(request, move(callback));
+}
+
+future<bool> CRaidVolume::submit_write(int secNr, const void *data, int secCnt, TRaidCallback callback) {
+    CRaidRequest request;
+    request.m_sector_i = secNr;
+    request.m_sector_cnt = secCnt;
+    request.m_write_data = data;
+    return submit_request(request, move(callback));
+}
+
+int CRaidVolume::poll() const {
+    return m_request_executor.pending();
+}
+
+void CRaidVolume::wait_all() {
+    m_request_executor.wait_idle();
+}
+
+bool CRaidVolume::execute_request(const CRaidRequest &request) {
+    const auto start = chrono::steady_clock::now();
+    shared_lock<shared_mutex> layout_lock(m_layout_mutex);
+    const bool success = request.m_read_data
+                             ? read_sectors(request.m_sector_i, request.m_read_data, request.m_sector_cnt)
+                             : write_sectors(request.m_sector_i, request.m_write_data, request.m_sector_cnt);
+    if (success)
+        count_request(!request.m_read_data, request.m_sector_cnt, start);
+    return success;
+}
+
+future<bool> CRaidVolume::submit_request(const CRaidRequest &request, TRaidCallback callback) {
+    // Shared, std::function requires a copyable task
+    auto completion = make_shared<promise<bool>>();
+    future<bool> result = completion->get_future();
+
+    const bool submitted = m_request_executor.submit([this, request, callback, completion] {
+        const bool success = execute_request(request);
+        if (callback)
+            callback(success);
+        completion->set_value(success);
+    });
+
+    // RAID is stopped
+    if (!submitted) {
+        if (callback)
+            callback(false);
+        completion->set_value(false);
+    }
+    return result;
+}
+
+bool CRaidVolume::read_sectors(int secNr, void *data, int secCnt) {
+    // Read buffer nullptr or Invalid starting raid sector
+    if (!data || secCnt < 0 || secCnt > (m_raid_size - 1) || m_status == RAID_FAILED)
+        return false;
+    // Reading past existing raid sectors
+    if (secNr < 0 || secNr + secCnt > m_raid_size)
+        return false;
+
+    auto cast_data = static_cast<int *>(data);
+    const int batch_stripe_cnt = max(1, READ_BATCH_ROWS / m_geometry.m_chunk_sectors);
+
+    // Drive sector run [first, last] of each drive & its offset (in sectors) inside batch buffer
+    int run_first[MAX_RAID_DEVICES];
+    int run_last[MAX_RAID_DEVICES];
+    int run_offset[MAX_RAID_DEVICES];
+    vector<int> batch_buffer;
+
+    for (int batch_i = secNr; batch_i < (secNr + secCnt);) {
+        // Batch spans at most READ_BATCH_ROWS stripe rows (at least one stripe) of one layout
+        int layout_first = 0;
+        int layout_end = 0;
+        const CRaidGeometry &geometry = sector_geometry(batch_i, layout_first, layout_end);
+        const int stripe_sector_cnt = geometry.stripe_sector_cnt();
+        const int batch_end = min({secNr + secCnt, layout_end,
+                                   (batch_i / stripe_sector_cnt + batch_stripe_cnt) * stripe_sector_cnt});
+        CStripeLockGuard batch_lock(m_stripe_locks, batch_i / stripe_sector_cnt, (batch_end - 1) / stripe_sector_cnt,
+                                    false);
+
+        for (int drive_i = 0; drive_i < geometry.m_devices; drive_i++) {
+            run_first[drive_i] = m_dev->m_Sectors;
+            run_last[drive_i] = -1;
+        }
+
+        // Find the drive sector run of each drive, parity sectors inside a run are read & skipped
+        for (CStripeIterator it(geometry, batch_i); it.m_raid_sector < batch_end; it.next()) {
+            if (drive_failed_at(it.m_drive_i, it.m_drive_sector_i))
+                continue;
+            run_first[it.m_drive_i] = min(run_first[it.m_drive_i], it.m_drive_sector_i);
+            run_last[it.m_drive_i] = max(run_last[it.m_drive_i], it.m_drive_sector_i);
+        }
+
+        int batch_sector_cnt = 0;
+        for (int drive_i = 0; drive_i < geometry.m_devices; drive_i++) {
+            run_offset[drive_i] = batch_sector_cnt;
+            if (run_last[drive_i] >= run_first[drive_i])
+                batch_sector_cnt += run_last[drive_i] - run_first[drive_i] + 1;
+        }
+        batch_buffer.resize(batch_sector_cnt * (SECTOR_SIZE / sizeof(int)));
+
+        // Issue one read per drive run, drives are read in parallel
+        CDriveIo run_ios[MAX_RAID_DEVICES];
+        int run_io_cnt = 0;
+        for (int drive_i = 0; drive_i < geometry.m_devices; drive_i++) {
+            const int run_cnt = run_last[drive_i] - run_first[drive_i] + 1;
+            if (run_cnt <= 0)
+                continue;
+            CDriveIo &io = run_ios[run_io_cnt++];
+            io.m_drive_i = drive_i;
+            io.m_sector_i = run_first[drive_i];
+            io.m_sector_cnt = run_cnt;
+            io.m_read_buffer = batch_buffer.data() + run_offset[drive_i] * (SECTOR_SIZE / sizeof(int));
+        }
+
+        int failed_drive = -1;
+        if ((failed_drive = m_io_engine.execute(run_ios, run_io_cnt)) >= 0) {
+            // Current drive failed in addition to other degraded drive
+            if (fail_drive(failed_drive) == RAID_FAILED)
+                return false;
+            // Repeat batch in degraded state
+            continue;
+        }
+
+        // Scatter runs into the caller buffer, sectors of "FAIL" drive (outside the runs) are reconstructed using
+        // parity. Runs decide, the failed drive may have changed since they were planned.
+        int reconstructed_cnt = 0;
+        for (CStripeIterator it(geometry, batch_i); it.m_raid_sector < batch_end; it.next()) {
+            int *sector_data = cast_data + (it.m_raid_sector - secNr) * (SECTOR_SIZE / sizeof(int));
+            const int drive_i = it.m_drive_i;
+            const int drive_sector_i = it.m_drive_sector_i;
+
+            if (drive_sector_i < run_first[drive_i] || drive_sector_i > run_last[drive_i]) {
+                reconstructed_cnt++;
+                if (m_row_cache.get(drive_sector_i, drive_i, sector_data)) {
+                    count_path(PATH_ROW_CACHE_HITS);
+                    continue;
+                }
+                int reconstruct_failed_drive = -1;
+                while ((reconstruct_failed_drive = reconstruct_sector(sector_data, drive_i, drive_sector_i)) >= 0)
+                    // Reading using parity failed, more drives failed than parity covers, raid failed
+                    if (fail_drive(reconstruct_failed_drive) == RAID_FAILED)
+                        return false;
+                m_row_cache.put(drive_sector_i, drive_i, sector_data);
+                continue;
+            }
+
+            const int run_sector_i = run_offset[drive_i] + drive_sector_i - run_first[drive_i];
+            memcpy(sector_data, batch_buffer.data() + run_sector_i * (SECTOR_SIZE / sizeof(int)), SECTOR_SIZE);
+        }
+
+        count_path(PATH_READ_SECTORS, batch_end - batch_i - reconstructed_cnt);
+        count_path(PATH_RECONSTRUCTED_SECTORS, reconstructed_cnt);
+
+        // Sectors of the write-back cache are newer than the drives
+        if (m_write_cache.enabled())
+            m_write_cache.read(batch_i, cast_data + (batch_i - secNr) * (SECTOR_SIZE / sizeof(int)), batch_end - batch_i);
+
+        batch_i = batch_end;
+    }
+
+    return true;
+}
+
+bool CRaidVolume::write_sectors(int secNr, const void *data, int secCnt) {
+    // Write buffer nullptr or Invalid starting raid sector
+    if (!data || secCnt < 0 || secCnt > (m_raid_size - 1) || m_status == RAID_FAILED)
+        return false;
+    // Writing past existing raid sectors
+    if (secNr < 0 || secNr + secCnt > m_raid_size)
+        return false;
+
+    auto cast_data = static_cast<const int *>(data);
+
+    for (int raid_i = secNr; raid_i < (secNr + secCnt);) {
+        // Stripe of the layout serving the sector, the first stripe of the old layout is written past the
+        // restriped sectors only
+        int layout_first = 0;
+        int layout_end = 0;
+        const int stripe_sector_cnt = sector_geometry(raid_i, layout_first, layout_end).stripe_sector_cnt();
+        const int stripe_i = raid_i / stripe_sector_cnt;
+        const int stripe_write_cnt = min({(stripe_i + 1) * stripe_sector_cnt, secNr + secCnt, layout_end}) - raid_i;
+
+        if (m_write_cache.enabled()) {
+            // Make room before locking the stripe, only one stripe lock is held at a time
+            if (!evict_write_cache(stripe_i))
+                return false;
+            CStripeLockGuard stripe_lock(m_stripe_locks, stripe_i, stripe_i, true);
+            m_write_cache.write(raid_i, cast_data, stripe_write_cnt);
+        } else {
+            CStripeLockGuard stripe_lock(m_stripe_locks, stripe_i, stripe_i, true);
+            if (!write_through(cast_data, raid_i, stripe_write_cnt))
+                return false;
+        }
+
+        // Increment buffer pointer past the written sectors
+        raid_i += stripe_write_cnt;
+        cast_data += stripe_write_cnt * (SECTOR_SIZE / sizeof(int));
+    }
+
+    return true;
+}
+
+bool CRaidVolume::readv(const CRaidExtent *extents, const int extent_cnt) {
+    const auto start = chrono::steady_clock::now();
+    uint64_t sector_cnt = 0;
+    shared_lock<shared_mutex> layout_lock(m_layout_mutex);
+    const bool success =
+        for_each_extent_batch(extents, extent_cnt, [this, &sector_cnt](const CRaidExtent *const *batch,
+                                                                       const int batch_cnt) {
+            for (int extent_i = 0; extent_i < batch_cnt; extent_i++)
+                sector_cnt += batch[extent_i]->m_sector_cnt;
+            return read_extents(batch, batch_cnt);
+        });
+    if (success)
+        count_request(false, sector_cnt, start);
+    return success;
+}
+
+bool CRaidVolume::writev(const CRaidExtent *extents, const int extent_cnt) {
+    const auto start = chrono::steady_clock::now();
+    uint64_t sector_cnt = 0;
+    shared_lock<shared_mutex> layout_lock(m_layout_mutex);
+    const bool success =
+        for_each_extent_batch(extents, extent_cnt, [this, &sector_cnt](const CRaidExtent *const *batch,
+                                                                       const int batch_cnt) {
+            for (int extent_i = 0; extent_i < batch_cnt; extent_i++)
+                sector_cnt += batch[extent_i]->m_sector_cnt;
+            return write_extents(batch, batch_cnt);
+        });
+    if (success)
+        count_request(true, sector_cnt, start);
+    return success;
+}
+
+bool CRaidVolume::for_each_extent_batch(const CRaidExtent *extents, const int extent_cnt,
+                                        const function<bool(const CRaidExtent *const *, int)> &batch_func) const {
+    if ((!extents && extent_cnt) || extent_cnt < 0 || m_status == RAID_FAILED || m_status == RAID_STOPPED)
+        return false;
+
+    vector<const CRaidExtent *> sorted;
+    sorted.reserve(extent_cnt);
+    for (int extent_i = 0; extent_i < extent_cnt; extent_i++) {
+        const CRaidExtent &extent = extents[extent_i];
+        // Buffer nullptr or extent past existing raid sectors
+        if (!extent.m_data || extent.m_sector_cnt < 0 || extent.m_sector_i < 0
+            || extent.m_sector_i > m_raid_size - extent.m_sector_cnt)
+            return false;
+        if (extent.m_sector_cnt > 0)
+            sorted.push_back(&extent);
+    }
+    // Extents starting at the same sector keep their order
+    stable_sort(sorted.begin(), sorted.end(), [](const CRaidExtent *a, const CRaidExtent *b) {
+        return a->m_sector_i < b->m_sector_i;
+    });
+
+    // Batches are processed in sorted order, an extent overlapping an earlier one of the batch joins it so overlapping
+    // writes keep their caller order
+    for (size_t batch_i = 0; batch_i < sorted.size();) {
+        size_t batch_end = batch_i;
+        int batch_sector_cnt = 0;
+        int batch_sector_end = 0;
+        while (batch_end < sorted.size()
+               && (batch_end == batch_i || sorted[batch_end]->m_sector_i < batch_sector_end
+                   || batch_sector_cnt + sorted[batch_end]->m_sector_cnt <= VECTOR_BATCH_SECTORS)) {
+            batch_sector_cnt += sorted[batch_end]->m_sector_cnt;
+            batch_sector_end = max(batch_sector_end, sorted[batch_end]->m_sector_i + sorted[batch_end]->m_sector_cnt);
+            batch_end++;
+        }
+        if (!batch_func(sorted.data() + batch_i, static_cast<int>(batch_end - batch_i)))
+            return false;
+        batch_i = batch_end;
+    }
+    return true;
+}
+
+bool CRaidVolume::read_extents(const CRaidExtent *const *extents, const int extent_cnt) {
+    // Calls func with the geometry & raid sectors [first, end) of each part of an extent served by one layout
+    const auto for_each_part = [this](const CRaidExtent &extent, const auto &func) {
+        const int extent_end = extent.m_sector_i + extent.m_sector_cnt;
+        for (int raid_i = extent.m_sector_i; raid_i < extent_end;) {
+            int layout_first = 0;
+            int layout_end = 0;
+            const CRaidGeometry &geometry = sector_geometry(raid_i, layout_first, layout_end);
+            func(geometry, raid_i, min(extent_end, layout_end));
+            raid_i = min(extent_end, layout_end);
+        }
+    };
+
+    vector<int> stripes;
+    for (int extent_i = 0; extent_i < extent_cnt; extent_i++)
+        for_each_part(*extents[extent_i], [&stripes](const CRaidGeometry &geometry, const int first, const int end) {
+            for (int stripe_i = first / geometry.stripe_sector_cnt();
+                 stripe_i <= (end - 1) / geometry.stripe_sector_cnt(); stripe_i++)
+                stripes.push_back(stripe_i);
+        });
+    CStripeLockGuard batch_lock(m_stripe_locks, stripes, false);
+
+    // Drive sector of an extent sector, its position in the batch buffer & its destination
+    struct CSectorRead {
+        int m_drive_sector_i;
+        int m_position;
+        int *m_data;
+    };
+    vector<CSectorRead> drive_reads[MAX_RAID_DEVICES];
+    vector<CSectorRead> failed_reads[MAX_RAID_DEVICES];
+    vector<CDriveIo> run_ios;
+    vector<int> run_positions;
+    vector<int> batch_buffer;
+
+    while (true) {
+        for (int drive_i = 0; drive_i < m_geometry.m_devices; drive_i++) {
+            drive_reads[drive_i].clear();
+            failed_reads[drive_i].clear();
+        }
+        run_ios.clear();
+        run_positions.clear();
+
+        // Sectors of "FAIL" drive are reconstructed using parity
+        for (int extent_i = 0; extent_i < extent_cnt; extent_i++) {
+            const CRaidExtent &extent = *extents[extent_i];
+            auto extent_data = static_cast<int *>(extent.m_data);
+            for_each_part(extent, [&](const CRaidGeometry &geometry, const int first, const int end) {
+                for (CStripeIterator it(geometry, first); it.m_raid_sector < end; it.next()) {
+                    const int position = it.m_raid_sector - extent.m_sector_i;
+                    const CSectorRead read = {it.m_drive_sector_i, 0,
+                                              extent_data + position * (SECTOR_SIZE / sizeof(int))};
+                    if (drive_failed_at(it.m_drive_i, it.m_drive_sector_i))
+                        failed_reads[it.m_drive_i].push_back(read);
+                    else
+                        drive_reads[it.m_drive_i].push_back(read);
+                }
+            });
+        }
+
+        // Merge sorted sectors of each drive into runs, small gaps are read along
+        int batch_sector_cnt = 0;
+        for (int drive_i = 0; drive_i < m_geometry.m_devices; drive_i++) {
+            vector<CSectorRead> &reads = drive_reads[drive_i];
+            sort(reads.begin(), reads.end(), [](const CSectorRead &a, const CSectorRead &b) {
+                return a.m_drive_sector_i < b.m_drive_sector_i;
+            });
+            for (CSectorRead &read : reads) {
+                if (run_ios.empty() || run_ios.back().m_drive_i != drive_i
+                    || read.m_drive_sector_i
+                           > run_ios.back().m_sector_i + run_ios.back().m_sector_cnt + VECTOR_GAP_SECTORS) {
+                    CDriveIo io;
+                    io.m_drive_i = drive_i;
+                    io.m_sector_i = read.m_drive_sector_i;
+                    run_ios.push_back(io);
+                    run_positions.push_back(batch_sector_cnt);
+                }
+                CDriveIo &run = run_ios.back();
+                const int run_end = max(run.m_sector_i + run.m_sector_cnt, read.m_drive_sector_i + 1);
+                batch_sector_cnt += run_end - run.m_sector_i - run.m_sector_cnt;
+                run.m_sector_cnt = run_end - run.m_sector_i;
+                read.m_position = run_positions.back() + read.m_drive_sector_i - run.m_sector_i;
+            }
+        }
+
+        // Issue all runs at once, runs of different drives are read in parallel
+        batch_buffer.resize(batch_sector_cnt * (SECTOR_SIZE / sizeof(int)));
+        for (size_t run_i = 0; run_i < run_ios.size(); run_i++)
+            run_ios[run_i].m_read_buffer = batch_buffer.data() + run_positions[run_i] * (SECTOR_SIZE / sizeof(int));
+
+        int failed_drive = -1;
+        if ((failed_drive = m_io_engine.execute(run_ios.data(), static_cast<int>(run_ios.size()))) < 0)
+            break;
+        // Current drive failed in addition to other degraded drive
+        if (fail_drive(failed_drive) == RAID_FAILED)
+            return false;
+        // Repeat batch in degraded state
+    }
+
+    for (int drive_i = 0; drive_i < m_geometry.m_devices; drive_i++) {
+        count_path(PATH_READ_SECTORS, drive_reads[drive_i].size());
+        count_path(PATH_RECONSTRUCTED_SECTORS, failed_reads[drive_i].size());
+        for (const CSectorRead &read : drive_reads[drive_i])
+            memcpy(read.m_data, batch_buffer.data() + read.m_position * (SECTOR_SIZE / sizeof(int)), SECTOR_SIZE);
+        for (const CSectorRead &read : failed_reads[drive_i]) {
+            if (m_row_cache.get(read.m_drive_sector_i, drive_i, read.m_data)) {
+                count_path(PATH_ROW_CACHE_HITS);
+                continue;
+            }
+            int reconstruct_failed_drive = -1;
+            while ((reconstruct_failed_drive = reconstruct_sector(read.m_data, drive_i, read.m_drive_sector_i)) >= 0)
+                // Reading using parity failed, more drives failed than parity covers, raid failed
+                if (fail_drive(reconstruct_failed_drive) == RAID_FAILED)
+                    return false;
+            m_row_cache.put(read.m_drive_sector_i, drive_i, read.m_data);
+        }
+    }
+
+    // Sectors of the write-back cache are newer than the drives
+    if (m_write_cache.enabled())
+        for (int extent_i = 0; extent_i < extent_cnt; extent_i++)
+            m_write_cache.read(extents[extent_i]->m_sector_i, static_cast<int *>(extents[extent_i]->m_data),
+                               extents[extent_i]->m_sector_cnt);
+    return true;
+}
+
+bool CRaidVolume::write_extents(const CRaidExtent *const *extents, const int extent_cnt) {
+    // Merge overlapping & adjacent sorted extents into runs
+    vector<int> run_firsts;
+    vector<int> run_ends;
+    for (int extent_i = 0; extent_i < extent_cnt; extent_i++) {
+        const int first = extents[extent_i]->m_sector_i;
+        const int end = first + extents[extent_i]->m_sector_cnt;
+        if (!run_ends.empty() && first <= run_ends.back())
+            run_ends.back() = max(run_ends.back(), end);
+        else {
+            run_firsts.push_back(first);
+            run_ends.push_back(end);
+        }
+    }
+
+    // Copy extents into their runs in caller order (extents point into the caller's array), later ones win
+    vector<const CRaidExtent *> caller_order(extents, extents + extent_cnt);
+    sort(caller_order.begin(), caller_order.end());
+    vector<vector<int>> run_data(run_firsts.size());
+    for (size_t run_i = 0; run_i < run_firsts.size(); run_i++)
+        run_data[run_i].resize((run_ends[run_i] - run_firsts[run_i]) * (SECTOR_SIZE / sizeof(int)));
+    for (const CRaidExtent *extent : caller_order) {
+        const size_t run_i =
+            upper_bound(run_firsts.begin(), run_firsts.end(), extent->m_sector_i) - run_firsts.begin() - 1;
+        memcpy(run_data[run_i].data() + (extent->m_sector_i - run_firsts[run_i]) * (SECTOR_SIZE / sizeof(int)),
+               extent->m_data, extent->m_sector_cnt * SECTOR_SIZE);
+    }
+
+    // Write-back cache absorbs the runs
+    if (m_write_cache.enabled()) {
+        for (size_t run_i = 0; run_i < run_firsts.size(); run_i++)
+            if (!write_sectors(run_firsts[run_i], run_data[run_i].data(), run_ends[run_i] - run_firsts[run_i]))
+                return false;
+        return true;
+    }
+
+    // Split runs at stripe ends (& the end of raid sectors served by the grown layout)
+    vector<CStripeWrite> writes;
+    vector<int> stripes;
+    for (size_t run_i = 0; run_i < run_firsts.size(); run_i++) {
+        for (int raid_i = run_firsts[run_i]; raid_i < run_ends[run_i];) {
+            int layout_first = 0;
+            int layout_end = 0;
+            const int stripe_sector_cnt = sector_geometry(raid_i, layout_first, layout_end).stripe_sector_cnt();
+            const int stripe_i = raid_i / stripe_sector_cnt;
+            CStripeWrite write;
+            write.m_data = run_data[run_i].data() + (raid_i - run_firsts[run_i]) * (SECTOR_SIZE / sizeof(int));
+            write.m_raid_sector = raid_i;
+            write.m_sector_cnt = min({(stripe_i + 1) * stripe_sector_cnt, run_ends[run_i], layout_end}) - raid_i;
+            writes.push_back(write);
+            stripes.push_back(stripe_i);
+            raid_i += write.m_sector_cnt;
+        }
+    }
+    CStripeLockGuard batch_lock(m_stripe_locks, stripes, true);
+    return write_through(writes.data(), static_cast<int>(writes.size()));
+}
+
+bool CRaidVolume::write_through(const int *data, const int raid_sector, const int sector_cnt) {
+    CStripeWrite write;
+    write.m_data = data;
+    write.m_raid_sector = raid_sector;
+    write.m_sector_cnt = sector_cnt;
+    return write_through(&write, 1);
+}
+
+bool CRaidVolume::write_through(const CStripeWrite *writes, const int write_cnt) {
+    for (int group_i = 0; group_i < write_cnt;) {
+        // Journaled writes are split into groups fitting into one transaction each
+        int group_end = write_cnt;
+        if (m_journal_active) {
+            int group_sector_cnt = 0;
+            for (group_end = group_i; group_end < write_cnt && group_end - group_i < JOURNAL_MAX_ENTRIES
+                                      && 1 + group_sector_cnt + writes[group_end].m_sector_cnt <= m_journal_sectors;
+                 group_end++)
+                group_sector_cnt += writes[group_end].m_sector_cnt;
+        }
+
+        // Stripes can be completed from the journal if the write is interrupted
+        int journal_seq = -1;
+        if (m_journal_active && !journal_commit(writes + group_i, group_end - group_i, journal_seq))
+            return false;
+
+        bool success = true;
+        int failed_drive = -1;
+        while ((failed_drive = write_stripes(writes + group_i, group_end - group_i)) >= 0) {
+            // Second drive failed, raid failed
+            if (fail_drive(failed_drive) == RAID_FAILED) {
+                success = false;
+                break;
+            }
+            // Repeat stripe writes in degraded state
+        }
+
+        if (journal_seq >= 0)
+            journal_applied(journal_seq);
+        if (!success)
+            return false;
+        group_i = group_end;
+    }
+    return true;
+}
+
+bool CRaidVolume::evict_write_cache(const int keep_stripe_i) {
+    int victim_i = -1;
+    while ((victim_i = m_write_cache.eviction_candidate(keep_stripe_i)) >= 0) {
+        CStripeLockGuard victim_lock(m_stripe_locks, victim_i, victim_i, true);
+        if (!flush_stripe(victim_i))
+            return false;
+    }
+    return true;
+}
+
+bool CRaidVolume::flush_stripe(const int stripe_i) {
+    vector<int> stripe_data;
+    vector<bool> valid;
+    // Flushed by another thread meanwhile
+    if (!m_write_cache.take(stripe_i, stripe_data, valid))
+        return true;
+
+    const int stripe_sector_cnt = static_cast<int>(valid.size());
+    const int stripe_first = stripe_i * stripe_sector_cnt;
+
+    // Runs of written sectors are written together, a completely written stripe is a single run
+    vector<CStripeWrite> runs;
+    for (int offset = 0; offset < stripe_sector_cnt;) {
+        if (!valid[offset]) {
+            offset++;
+            continue;
+        }
+        int run_end = offset;
+        while (run_end < stripe_sector_cnt && valid[run_end])
+            run_end++;
+        CStripeWrite run;
+        run.m_data = stripe_data.data() + offset * (SECTOR_SIZE / sizeof(int));
+        run.m_raid_sector = stripe_first + offset;
+        run.m_sector_cnt = run_end - offset;
+        runs.push_back(run);
+        offset = run_end;
+    }
+    return write_through(runs.data(), static_cast<int>(runs.size()));
+}
+
+bool CRaidVolume::flush() {
+    shared_lock<shared_mutex> layout_lock(m_layout_mutex);
+    return flush_write_cache();
+}
+
+bool CRaidVolume::flush_write_cache() {
+    if (m_status == RAID_STOPPED || m_status == RAID_FAILED)
+        return m_status == RAID_STOPPED;
+
+    bool success = true;
+    for (const int stripe_i : m_write_cache.stripes()) {
+        CStripeLockGuard stripe_lock(m_stripe_locks, stripe_i, stripe_i, true);
+        success = flush_stripe(stripe_i) && success;
+    }
+    return success;
+}
+
+bool CRaidVolume::journal_commit(const CStripeWrite *writes, const int write_cnt, int &seq) {
+    CJournalCommit commit;
+    commit.m_writes = writes;
+    commit.m_write_cnt = write_cnt;
+
+    unique_lock<mutex> journal_lock(m_journal_mutex);
+    m_journal_queue.push_back(&commit);
+    while (!commit.m_done) {
+        // Another thread is writing a transaction, the commit joins the next one
+        if (m_journal_committing) {
+            m_journal_cv.wait(journal_lock);
+            continue;
+        }
+        m_journal_committing = true;
+        journal_write_txn(journal_lock);
+        m_journal_committing = false;
+        m_journal_cv.notify_all();
+    }
+
+    seq = commit.m_seq;
+    return commit.m_success;
+}
+
+void CRaidVolume::journal_write_txn(unique_lock<mutex> &journal_lock) {
+    // Take queued commits fitting into one transaction, the first one always fits
+    vector<CJournalCommit *> commits;
+    vector<const CStripeWrite *> entries;
+    int data_sector_cnt = 0;
+    while (!m_journal_queue.empty()) {
+        const CJournalCommit &commit = *m_journal_queue.front();
+        int commit_sector_cnt = 0;
+        for (int write_i = 0; write_i < commit.m_write_cnt; write_i++)
+            commit_sector_cnt += commit.m_writes[write_i].m_sector_cnt;
+        if (!commits.empty() && (static_cast<int>(entries.size()) + commit.m_write_cnt > JOURNAL_MAX_ENTRIES
+                                 || 1 + data_sector_cnt + commit_sector_cnt > m_journal_sectors))
+            break;
+        for (int write_i = 0; write_i < commit.m_write_cnt; write_i++)
+            entries.push_back(&commit.m_writes[write_i]);
+        data_sector_cnt += commit_sector_cnt;
+        commits.push_back(m_journal_queue.front());
+        m_journal_queue.pop_front();
+    }
+
+    // Transactions don't wrap around the journal end, sectors of pending transactions aren't overwritten
+    const int txn_sector_cnt = 1 + data_sector_cnt;
+    const int position = m_journal_head + txn_sector_cnt <= m_journal_sectors ? m_journal_head : 0;
+    m_journal_cv.wait(journal_lock, [&] {
+        for (const CJournalTxn &txn : m_journal_txns)
+            if (txn.m_position < position + txn_sector_cnt && position < txn.m_position + txn.m_sector_cnt)
+                return false;
+        return true;
+    });
+
+    const int seq = m_journal_seq++;
+    m_journal_txns.push_back({seq, position, txn_sector_cnt, static_cast<int>(commits.size())});
+    m_journal_head = position + txn_sector_cnt;
+
+    // Header with entries followed by data sectors of all entries, oldest pending transaction is the replay start
+    vector<int> txn_buffer(txn_sector_cnt * (SECTOR_SIZE / sizeof(int)), 0);
+    txn_buffer[JOURNAL_MAGIC_INDEX] = JOURNAL_MAGIC;
+    txn_buffer[JOURNAL_SEQ_INDEX] = seq;
+    txn_buffer[JOURNAL_TAIL_SEQ_INDEX] = m_journal_txns.front().m_seq;
+    txn_buffer[JOURNAL_ENTRY_CNT_INDEX] = static_cast<int>(entries.size());
+    txn_buffer[JOURNAL_SECTOR_CNT_INDEX] = data_sector_cnt;
+    int *txn_data = txn_buffer.data() + SECTOR_SIZE / sizeof(int);
+    for (size_t entry_i = 0; entry_i < entries.size(); entry_i++) {
+        txn_buffer[JOURNAL_ENTRIES_INDEX + 2 * entry_i] = entries[entry_i]->m_raid_sector;
+        txn_buffer[JOURNAL_ENTRIES_INDEX + 2 * entry_i + 1] = entries[entry_i]->m_sector_cnt;
+        if (entries[entry_i]->m_sector_cnt > 0)
+            memcpy(txn_data, entries[entry_i]->m_data, entries[entry_i]->m_sector_cnt * SECTOR_SIZE);
+        txn_data += entries[entry_i]->m_sector_cnt * (SECTOR_SIZE / sizeof(int));
+    }
+    txn_buffer[JOURNAL_CRC_INDEX] = static_cast<int>(crc32c(txn_buffer.data(), txn_sector_cnt * SECTOR_SIZE));
+
+    // Other threads queue entries meanwhile
+    journal_lock.unlock();
+    bool success = true;
+    int failed_drive = -1;
+    do {
+        // Write copies to OK drives in parallel, repeat on other drives after a drive failure
+        CDriveIo copy_ios[JOURNAL_COPY_CNT];
+        int copy_cnt = 0;
+        for (int drive_i = 0; drive_i < m_geometry.m_devices && copy_cnt < JOURNAL_COPY_CNT; drive_i++) {
+            if (drive_failed(drive_i))
+                continue;
+            CDriveIo &io = copy_ios[copy_cnt++];
+            io.m_drive_i = drive_i;
+            io.m_sector_i = m_journal_first_sector + position;
+            io.m_sector_cnt = txn_sector_cnt;
+            io.m_write_buffer = txn_buffer.data();
+        }
+        if ((failed_drive = m_io_engine.execute(copy_ios, copy_cnt)) >= 0 && fail_drive(failed_drive) == RAID_FAILED)
+            success = false;
+    } while (success && failed_drive >= 0);
+    journal_lock.lock();
+
+    // Commits of a failed transaction are never applied
+    if (!success) {
+        m_journal_txns.back().m_pending_cnt = 0;
+        while (!m_journal_txns.empty() && m_journal_txns.front().m_pending_cnt == 0)
+            m_journal_txns.pop_front();
+    }
+
+    for (CJournalCommit *commit : commits) {
+        commit->m_seq = seq;
+        commit->m_success = success;
+        commit->m_done = true;
+    }
+}
+
+void CRaidVolume::journal_applied(const int seq) {
+    lock_guard<mutex> journal_lock(m_journal_mutex);
+    m_journal_txns[seq - m_journal_txns.front().m_seq].m_pending_cnt--;
+    // Journal sectors are reused in order, a transaction is released once all older ones are applied
+    while (!m_journal_txns.empty() && m_journal_txns.front().m_pending_cnt == 0)
+        m_journal_txns.pop_front();
+    m_journal_cv.notify_all();
+}
+
+bool CRaidVolume::journal_replay() {
+    vector<int> journal_buffer(m_journal_sectors * (SECTOR_SIZE / sizeof(int)));
+    // Complete transactions by sequence number, copies of a transaction are equal
+    map<int, vector<int>> txns;
+    int max_seq = -1;
+    int tail_seq = 0;
+
+    for (int drive_i = 0; drive_i < m_geometry.m_devices; drive_i++) {
+        if (drive_failed(drive_i))
+            continue;
+        if (!m_io_engine.read(drive_i, m_journal_first_sector, journal_buffer.data(), m_journal_sectors))
+            continue;
+        for (int position = 0; position < m_journal_sectors;) {
+            const int *txn = journal_buffer.data() + position * (SECTOR_SIZE / sizeof(int));
+            if (!journal_txn_valid(txn, m_journal_sectors - position)) {
+                position++;
+                continue;
+            }
+            const int txn_sector_cnt = 1 + txn[JOURNAL_SECTOR_CNT_INDEX];
+            // Newest transaction knows the oldest one which may not be applied
+            if (txn[JOURNAL_SEQ_INDEX] > max_seq) {
+                max_seq = txn[JOURNAL_SEQ_INDEX];
+                tail_seq = txn[JOURNAL_TAIL_SEQ_INDEX];
+            }
+            txns.emplace(txn[JOURNAL_SEQ_INDEX], vector<int>(txn, txn + txn_sector_cnt * (SECTOR_SIZE / sizeof(int))));
+            position += txn_sector_cnt;
+        }
+    }
+
+    for (auto txn_it = txns.lower_bound(tail_seq); txn_it != txns.end() && txn_it->first <= max_seq; ++txn_it) {
+        const int *txn = txn_it->second.data();
+        const int *entry_data = txn + SECTOR_SIZE / sizeof(int);
+        for (int entry_i = 0; entry_i < txn[JOURNAL_ENTRY_CNT_INDEX]; entry_i++) {
+            const int raid_sector = txn[JOURNAL_ENTRIES_INDEX + 2 * entry_i];
+            const int sector_cnt = txn[JOURNAL_ENTRIES_INDEX + 2 * entry_i + 1];
+            // Checkpoint or an entry not describing a stripe write of this RAID
+            if (sector_cnt < 1 || raid_sector < 0 || raid_sector > m_raid_size - sector_cnt)
+                break;
+
+            // Entry written before a reshape checkpoint advanced may span stripes of the grown layout
+            for (int raid_i = raid_sector; raid_i < raid_sector + sector_cnt;) {
+                int layout_first = 0;
+                int layout_end = 0;
+                const int stripe_sector_cnt = sector_geometry(raid_i, layout_first, layout_end).stripe_sector_cnt();
+                const int stripe_i = raid_i / stripe_sector_cnt;
+                const int stripe_first = max(stripe_i * stripe_sector_cnt, layout_first);
+                const int stripe_end = min((stripe_i + 1) * stripe_sector_cnt, layout_end);
+                const int part_end = min(raid_sector + sector_cnt, stripe_end);
+
+                // Whole stripe is rewritten, its parity is calculated from data again
+                vector<int> stripe_buffer((stripe_end - stripe_first) * (SECTOR_SIZE / sizeof(int)));
+                int *part_buffer = stripe_buffer.data() + (raid_i - stripe_first) * (SECTOR_SIZE / sizeof(int));
+                if (!read_sectors(stripe_first, stripe_buffer.data(), raid_i - stripe_first)
+                    || !read_sectors(part_end, part_buffer + (part_end - raid_i) * (SECTOR_SIZE / sizeof(int)),
+                                     stripe_end - part_end))
+                    return false;
+                memcpy(part_buffer, entry_data, (part_end - raid_i) * SECTOR_SIZE);
+                CStripeLockGuard stripe_lock(m_stripe_locks, stripe_i, stripe_i, true);
+                if (!write_through(stripe_buffer.data(), stripe_first, stripe_end - stripe_first))
+                    return false;
+                entry_data += (part_end - raid_i) * (SECTOR_SIZE / sizeof(int));
+                raid_i = part_end;
+            }
+        }
+    }
+
+    // Replayed transactions are applied, a checkpoint makes the next start skip them
+    m_journal_seq = max_seq + 1;
+    m_journal_head = 0;
+    m_journal_active = true;
+    int checkpoint_seq = -1;
+    if (!journal_commit(nullptr, 0, checkpoint_seq))
+        return false;
+    journal_applied(checkpoint_seq);
+    return true;
+}
+
+bool CRaidVolume::journal_txn_valid(const int *txn, const int sector_cnt) {
+    const int data_sector_cnt = txn[JOURNAL_SECTOR_CNT_INDEX];
+    const int entry_cnt = txn[JOURNAL_ENTRY_CNT_INDEX];
+    if (txn[JOURNAL_MAGIC_INDEX] != JOURNAL_MAGIC || data_sector_cnt < 0 || data_sector_cnt >= sector_cnt
+        || entry_cnt < 0 || entry_cnt > JOURNAL_MAX_ENTRIES)
+        return false;
+
+    // Checksum covers the header with a zero checksum field & the data sectors
+    INT_SECTOR_BUFFER(header);
+    memcpy(header, txn, SECTOR_SIZE);
+    header[JOURNAL_CRC_INDEX] = 0;
+    const uint32_t crc = crc32c(txn + SECTOR_SIZE / sizeof(int), data_sector_cnt * SECTOR_SIZE,
+                                crc32c(header, SECTOR_SIZE));
+    return static_cast<int>(crc) == txn[JOURNAL_CRC_INDEX];
+}
+
+bool CRaidVolume::validate_t_blk_dev(const TBlkDev &dev) {
+    if (dev.m_Devices < 3 || dev.m_Devices > MAX_RAID_DEVICES)
+        return false;
+    if (dev.m_Sectors < MIN_DEVICE_SECTORS || dev.m_Sectors > MAX_DEVICE_SECTORS)
+        return false;
+    if (!dev.m_Read)
+        return false;
+    if (!dev.m_Write)
+        return false;
+    return true;
+}
+
+int CRaidVolume::write_stripe(const int *data, const int raid_sector, const int sector_cnt) {
+    const CRaidGeometry &geometry = sector_geometry(raid_sector);
+    const int data_drive_cnt = geometry.data_drive_cnt();
+    const int chunk_sectors = geometry.m_chunk_sectors;
+    const int stripe_sector_cnt = chunk_sectors * data_drive_cnt;
+    const int stripe_i = raid_sector / stripe_sector_cnt;
+    const int stripe_first = stripe_i * stripe_sector_cnt;
+    const int first_row = stripe_i * chunk_sectors;
+    // Resync watermark never splits a stripe
+    const int failed_drive_i = failed_drive_at(first_row);
+
+    // Record the write of degraded rows before writing them, their reconstructed sectors change
+    if (failed_drive_i >= 0) {
+        m_row_cache.invalidate(first_row, chunk_sectors);
+        for (int raid_i = raid_sector; raid_i < raid_sector + min(sector_cnt, chunk_sectors); raid_i++) {
+            int bitmap_failed_drive = -1;
+            if ((bitmap_failed_drive = bitmap_mark(first_row + raid_i % chunk_sectors)) >= 0)
+                return bitmap_failed_drive;
+        }
+    }
+
+    // Whole stripe is being written -> calculate parity from data, write each drive once
+    if (sector_cnt == stripe_sector_cnt)
+        return write_full_stripes(data, stripe_i);
+
+    TRowWrites rows;
+    add_stripe_rows(data, raid_sector, sector_cnt, rows);
+
+    // No failed drive in the stripe, all rows are updated with one batch of reads & one batch of writes
+    // Dual parity rows reconstruct sectors of their failed drives within that batch as well
+    if (failed_drive_i < 0 || geometry.m_parity_cnt == 2)
+        return write_partial_rows(rows);
+
+    int failed_drive = -1;
+    for (const auto &[sector_i, row] : rows) {
+        for (int chunk_i = 0; chunk_i < data_drive_cnt; chunk_i++) {
+            if (!row.m_data[chunk_i])
+                continue;
+            const int raid_i = stripe_first + chunk_i * chunk_sectors + sector_i - first_row;
+            if ((failed_drive = write_degraded_sector(row.m_data[chunk_i], raid_i, failed_drive_i)) >= 0)
+                return failed_drive;
+        }
+    }
+
+    return -1;
+}
+
+void CRaidVolume::add_stripe_rows(const int *data, const int raid_sector, const int sector_cnt,
+                                  TRowWrites &rows) const {
+    const CRaidGeometry &geometry = sector_geometry(raid_sector);
+    const int chunk_sectors = geometry.m_chunk_sectors;
+    const int stripe_sector_cnt = geometry.stripe_sector_cnt();
+    const int stripe_i = raid_sector / stripe_sector_cnt;
+    const int stripe_first = stripe_i * stripe_sector_cnt;
+
+    // Sectors of one row are strided by the chunk size in raid sectors
+    for (int raid_i = raid_sector; raid_i < raid_sector + sector_cnt; raid_i++) {
+        const int stripe_offset = raid_i - stripe_first;
+        rows[stripe_i * chunk_sectors + stripe_offset % chunk_sectors].m_data[stripe_offset / chunk_sectors] =
+            data + (raid_i - raid_sector) * (SECTOR_SIZE / sizeof(int));
+    }
+}
+
+int CRaidVolume::write_stripes(const CStripeWrite *writes, const int write_cnt) {
+    TRowWrites rows;
+    int failed_drive = -1;
+
+    for (int write_i = 0; write_i < write_cnt; write_i++) {
+        const CStripeWrite &write = writes[write_i];
+        const CRaidGeometry &geometry = sector_geometry(write.m_raid_sector);
+        const int stripe_sector_cnt = geometry.stripe_sector_cnt();
+        const int first_row = write.m_raid_sector / stripe_sector_cnt * geometry.m_chunk_sectors;
+        // Whole & degraded stripes take their own paths
+        if (write.m_sector_cnt == stripe_sector_cnt || failed_drive_at(first_row) >= 0) {
+            if ((failed_drive = write_stripe(write.m_data, write.m_raid_sector, write.m_sector_cnt)) >= 0)
+                return failed_drive;
+            continue;
+        }
+        add_stripe_rows(write.m_data, write.m_raid_sector, write.m_sector_cnt, rows);
+    }
+
+    return write_partial_rows(rows);
+}
+
+int CRaidVolume::write_full_stripes(const int *stripe_data, const int stripe_i, const int stripe_cnt) const {
+    count_path(PATH_FULL_STRIPES, stripe_cnt);
+    const CRaidGeometry &geometry = stripe_geometry(stripe_i);
+    const int data_drive_cnt = geometry.data_drive_cnt();
+    const int chunk_sectors = geometry.m_chunk_sectors;
+    const int chunk_ints = chunk_sectors * (SECTOR_SIZE / sizeof(int));
+
+    // Multiple stripes are gathered into one run per drive, a single stripe is written from its chunks
+    vector<int> parity_buffer(geometry.m_parity_cnt * chunk_ints);
+    vector<int> run_buffer(stripe_cnt > 1 ? geometry.m_devices * stripe_cnt * chunk_ints : 0);
+    vector<CDriveIo> chunk_ios;
+    int drive_ios[MAX_RAID_DEVICES];
+    fill_n(drive_ios, geometry.m_devices, -1);
+    for (int stripe_offset = 0; stripe_offset < stripe_cnt; stripe_offset++) {
+        const int *data = stripe_data + stripe_offset * data_drive_cnt * chunk_ints;
+        const int first_row = (stripe_i + stripe_offset) * chunk_sectors;
+
+        // Parity chunk is the xor of all data chunks, xored in a single pass, followed by the Q chunk if dual parity
+        fill(parity_buffer.begin(), parity_buffer.end(), 0);
+        const void *stripe_chunks[MAX_RAID_DEVICES];
+        for (int chunk_i = 0; chunk_i < data_drive_cnt; chunk_i++)
+            stripe_chunks[chunk_i] = data + chunk_i * chunk_ints;
+        for (int parity_i = 0; parity_i < geometry.m_parity_cnt; parity_i++)
+            stripe_chunks[data_drive_cnt + parity_i] = parity_buffer.data() + parity_i * chunk_ints;
+        if (geometry.m_parity_cnt == 2)
+            CGfKernel::gen_syndrome(parity_buffer.data(), parity_buffer.data() + chunk_ints, stripe_chunks,
+                                    data_drive_cnt, chunk_sectors * SECTOR_SIZE);
+        else
+            CXorKernel::xor_blocks(parity_buffer.data(), stripe_chunks, data_drive_cnt, chunk_sectors * SECTOR_SIZE);
+
+        // Data chunks & parity chunks are written to all drives in parallel, failed drives of the stripe are skipped
+        int drives[MAX_RAID_DEVICES];
+        geometry.stripe_drives_of(first_row, drives);
+        for (int block_i = 0; block_i < geometry.m_devices; block_i++) {
+            const int drive_i = drives[block_i];
+            if (drive_failed_at(drive_i, first_row))
+                continue;
+            const void *chunk = stripe_chunks[block_i];
+            if (stripe_cnt > 1) {
+                int *run_chunk = run_buffer.data() + (drive_i * stripe_cnt + stripe_offset) * chunk_ints;
+                memcpy(run_chunk, chunk, chunk_sectors * SECTOR_SIZE);
+                chunk = run_chunk;
+            }
+            // Consecutive stripes of a drive become one device call
+            if (drive_ios[drive_i] >= 0
+                && chunk_ios[drive_ios[drive_i]].m_sector_i + chunk_ios[drive_ios[drive_i]].m_sector_cnt == first_row) {
+                chunk_ios[drive_ios[drive_i]].m_sector_cnt += chunk_sectors;
+                continue;
+            }
+            drive_ios[drive_i] = static_cast<int>(chunk_ios.size());
+            CDriveIo io;
+            io.m_drive_i = drive_i;
+            io.m_sector_i = first_row;
+            io.m_sector_cnt = chunk_sectors;
+            io.m_write_buffer = chunk;
+            chunk_ios.push_back(io);
+        }
+    }
+
+    return m_io_engine.execute(chunk_ios.data(), static_cast<int>(chunk_ios.size()));
+}
+
+int CRaidVolume::write_partial_rows(const TRowWrites &rows) const {
+    // Rows may belong to both layouts of a reshape, the grown one has the most drives
+    const int drive_cnt = m_geometry.m_devices;
+    const int parity_cnt = m_geometry.m_parity_cnt;
+    const int row_cnt = static_cast<int>(rows.size());
+
+    // Drives of each row in block order (data chunks, P, Q), drives read & written in each row
+    vector<int> row_sectors;
+    vector<const CRowWrite *> row_writes;
+    vector<int> row_drives(row_cnt * drive_cnt);
+    vector<char> row_rmw(row_cnt, false);
+    vector<char> row_reconstruct(row_cnt, false);
+    vector<char> read_drives(row_cnt * drive_cnt, false);
+    vector<char> write_drives(row_cnt * drive_cnt, false);
+    for (const auto &[sector_i, row] : rows) {
+        const int row_i = static_cast<int>(row_sectors.size());
+        row_sectors.push_back(sector_i);
+        row_writes.push_back(&row);
+        const CRaidGeometry &geometry = row_geometry(sector_i);
+        const int block_cnt = geometry.m_devices;
+        const int data_drive_cnt = geometry.data_drive_cnt();
+        int *drives = row_drives.data() + row_i * drive_cnt;
+        geometry.stripe_drives_of(sector_i, drives);
+
+        bool failed[MAX_RAID_DEVICES];
+        int written_cnt = 0;
+        bool written_failed = false;
+        bool parity_failed = false;
+        bool untouched_failed = false;
+        for (int block_i = 0; block_i < block_cnt; block_i++) {
+            failed[block_i] = drive_failed_at(drives[block_i], sector_i);
+            if (block_i >= data_drive_cnt)
+                parity_failed = parity_failed || failed[block_i];
+            else if (row.m_data[block_i]) {
+                written_cnt++;
+                written_failed = written_failed || failed[block_i];
+            } else
+                untouched_failed = untouched_failed || failed[block_i];
+        }
+
+        // Read-modify-write reads written sectors + parity, reconstruct-write reads the untouched sectors
+        // Untouched sectors of a failed drive (dual parity) are reconstructed from all readable sectors of the row
+        const bool read_modify_write = !written_failed && !parity_failed && !untouched_failed
+                                       && written_cnt + parity_cnt < data_drive_cnt - written_cnt;
+        row_rmw[row_i] = read_modify_write;
+        row_reconstruct[row_i] = untouched_failed;
+        if (untouched_failed)
+            count_path(PATH_DEGRADED_SECTORS, written_cnt);
+        else
+            count_path(read_modify_write ? PATH_RMW_ROWS : PATH_RCW_ROWS);
+        for (int block_i = 0; block_i < block_cnt; block_i++) {
+            const bool parity = block_i >= data_drive_cnt;
+            const bool written = parity || row.m_data[block_i];
+            write_drives[row_i * drive_cnt + drives[block_i]] = written && !failed[block_i];
+            read_drives[row_i * drive_cnt + drives[block_i]] =
+                !failed[block_i]
+                && (untouched_failed || (parity ? read_modify_write : written == read_modify_write));
+        }
+    }
+
+    // Lays out sectors of marked drives drive by drive into slots of a buffer, consecutive rows of a drive become
+    // one device call. Returns number of slots, io buffers are set to slot indices.
+    const auto plan_ios = [&](const vector<char> &drives, vector<int> &slots, vector<CDriveIo> &ios,
+                              vector<int> &io_slots) {
+        slots.assign(row_cnt * drive_cnt, -1);
+        int slot_cnt = 0;
+        for (int drive_i = 0; drive_i < drive_cnt; drive_i++) {
+            for (int row_i = 0; row_i < row_cnt; row_i++) {
+                if (!drives[row_i * drive_cnt + drive_i])
+                    continue;
+                if (ios.empty() || ios.back().m_drive_i != drive_i
+                    || ios.back().m_sector_i + ios.back().m_sector_cnt != row_sectors[row_i]) {
+                    CDriveIo io;
+                    io.m_drive_i = drive_i;
+                    io.m_sector_i = row_sectors[row_i];
+                    ios.push_back(io);
+                    io_slots.push_back(slot_cnt);
+                }
+                ios.back().m_sector_cnt++;
+                slots[row_i * drive_cnt + drive_i] = slot_cnt++;
+            }
+        }
+        return slot_cnt;
+    };
+
+    // Read old data + old parity (read-modify-write), untouched data (reconstruct-write) or everything readable
+    // (reconstruction) of all rows in parallel
+    vector<int> read_slots;
+    vector<CDriveIo> read_ios;
+    vector<int> read_io_slots;
+    vector<int> read_buffer(plan_ios(read_drives, read_slots, read_ios, read_io_slots) * (SECTOR_SIZE / sizeof(int)));
+    for (size_t io_i = 0; io_i < read_ios.size(); io_i++)
+        read_ios[io_i].m_read_buffer = read_buffer.data() + read_io_slots[io_i] * (SECTOR_SIZE / sizeof(int));
+
+    int failed_drive = -1;
+    if ((failed_drive = m_io_engine.execute(read_ios.data(), static_cast<int>(read_ios.size()))) >= 0)
+        return failed_drive;
+
+    // Stage new data & calculate the new parity of each row, parity of a failed drive goes to a scratch sector
+    vector<int> write_slots;
+    vector<CDriveIo> write_ios;
+    vector<int> write_io_slots;
+    vector<int> write_buffer(plan_ios(write_drives, write_slots, write_ios, write_io_slots)
+                             * (SECTOR_SIZE / sizeof(int)));
+    for (int row_i = 0; row_i < row_cnt; row_i++) {
+        const int *drives = row_drives.data() + row_i * drive_cnt;
+        const CRowWrite &row = *row_writes[row_i];
+        const CRaidGeometry &geometry = row_geometry(row_sectors[row_i]);
+        const int data_drive_cnt = geometry.data_drive_cnt();
+        const auto read_sector = [&](const int block_i) {
+            return read_buffer.data() + read_slots[row_i * drive_cnt + drives[block_i]] * (SECTOR_SIZE / sizeof(int));
+        };
+
+        for (int chunk_i = 0; chunk_i < data_drive_cnt; chunk_i++) {
+            const int slot = write_slots[row_i * drive_cnt + drives[chunk_i]];
+            if (row.m_data[chunk_i] && slot >= 0)
+                memcpy(write_buffer.data() + slot * (SECTOR_SIZE / sizeof(int)), row.m_data[chunk_i], SECTOR_SIZE);
+        }
+
+        INT_SECTOR_BUFFER(parity_scratch[2]);
+        int *parity_sectors[2];
+        for (int parity_i = 0; parity_i < parity_cnt; parity_i++) {
+            const int slot = write_slots[row_i * drive_cnt + drives[data_drive_cnt + parity_i]];
+            parity_sectors[parity_i] =
+                slot >= 0 ? write_buffer.data() + slot * (SECTOR_SIZE / sizeof(int)) : parity_scratch[parity_i];
+        }
+
+        // New P = old P ^ old data ^ new data, new Q = old Q ^ g^chunk_i * (old data ^ new data) of written chunks
+        if (row_rmw[row_i]) {
+            const void *xor_sectors[2 * MAX_RAID_DEVICES];
+            int xor_sector_cnt = 0;
+            xor_sectors[xor_sector_cnt++] = read_sector(data_drive_cnt);
+            for (int chunk_i = 0; chunk_i < data_drive_cnt; chunk_i++) {
+                if (!row.m_data[chunk_i])
+                    continue;
+                xor_sectors[xor_sector_cnt++] = read_sector(chunk_i);
+                xor_sectors[xor_sector_cnt++] = row.m_data[chunk_i];
+            }
+            memset(parity_sectors[0], 0, SECTOR_SIZE);
+            CXorKernel::xor_blocks(parity_sectors[0], xor_sectors, xor_sector_cnt, SECTOR_SIZE);
+
+            if (parity_cnt == 2) {
+                memcpy(parity_sectors[1], read_sector(data_drive_cnt + 1), SECTOR_SIZE);
+                for (int chunk_i = 0; chunk_i < data_drive_cnt; chunk_i++) {
+                    if (!row.m_data[chunk_i])
+                        continue;
+                    CGfKernel::mul_xor(parity_sectors[1], read_sector(chunk_i), CGfKernel::pow2(chunk_i), SECTOR_SIZE);
+                    CGfKernel::mul_xor(parity_sectors[1], row.m_data[chunk_i], CGfKernel::pow2(chunk_i),
+                                       SECTOR_SIZE);
+                }
+            }
+            continue;
+        }
+
+        // Reconstruct-write, parity of new & untouched data, untouched data of failed drives is reconstructed first
+        INT_SECTOR_BUFFER(lost_buffer[2]);
+        void *blocks[MAX_RAID_DEVICES];
+        if (row_reconstruct[row_i]) {
+            int lost[2] = {-1, -1};
+            int lost_cnt = 0;
+            for (int block_i = 0; block_i < geometry.m_devices; block_i++) {
+                if (read_slots[row_i * drive_cnt + drives[block_i]] >= 0) {
+                    blocks[block_i] = read_sector(block_i);
+                    continue;
+                }
+                blocks[block_i] = lost_buffer[lost_cnt];
+                lost[lost_cnt++] = block_i;
+            }
+            CGfKernel::recover(blocks, data_drive_cnt, lost[0], lost[1], SECTOR_SIZE);
+        }
+
+        const void *data_sectors[MAX_RAID_DEVICES];
+        for (int chunk_i = 0; chunk_i < data_drive_cnt; chunk_i++) {
+            if (row.m_data[chunk_i])
+                data_sectors[chunk_i] = row.m_data[chunk_i];
+            else
+                data_sectors[chunk_i] = row_reconstruct[row_i] ? blocks[chunk_i] : read_sector(chunk_i);
+        }
+        if (parity_cnt == 2)
+            CGfKernel::gen_syndrome(parity_sectors[0], parity_sectors[1], data_sectors, data_drive_cnt, SECTOR_SIZE);
+        else {
+            memset(parity_sectors[0], 0, SECTOR_SIZE);
+            CXorKernel::xor_blocks(parity_sectors[0], data_sectors, data_drive_cnt, SECTOR_SIZE);
+        }
+    }
+
+    // Write new data and the new parity in parallel
+    for (size_t io_i = 0; io_i < write_ios.size(); io_i++)
+        write_ios[io_i].m_write_buffer = write_buffer.data() + write_io_slots[io_i] * (SECTOR_SIZE / sizeof(int));
+    return m_io_engine.execute(write_ios.data(), static_cast<int>(write_ios.size()));
+}
+
+int CRaidVolume::write_degraded_sector(const int *data, const int raid_sector, const int failed_drive_i) const {
+    // Translate raid index to "physical" drive/sector/parity_drive indices
+    int drive_i = 0;
+    int sector_i = 0;
+    int parity_drive_i = 0;
+    sector_geometry(raid_sector).raid_sector_to_physical(raid_sector, drive_i, sector_i, parity_drive_i);
+    int failed_drive = -1;
+
+    // Try write data to "FAIL" drive -> only change stripe parity so the "newly
+    // written" dead sector data can be recalculated from new parity + other good sectors
+    if (failed_drive_i == drive_i) {
+        count_path(PATH_DEAD_DATA_SECTORS);
+        // Calculate new parity sector of another "OK" drive
+        INT_SECTOR_BUFFER(new_parity_buffer) = {};
+        if ((failed_drive = xor_get_parity_supplement_dead_sector(new_parity_buffer, parity_drive_i, drive_i,
+                                                                  data, sector_i)) >= 0)
+            return failed_drive;
+
+        // Write newly calculated parity to "OK" drive
+        if (!m_io_engine.write(parity_drive_i, sector_i, new_parity_buffer, 1))
+            return parity_drive_i;
+        return -1;
+    }
+
+    // Try write data to "OK" drive in degraded state, parity is on dead drive -> just write data
+    if (failed_drive_i == parity_drive_i) {
+        count_path(PATH_DEAD_PARITY_SECTORS);
+        if (!m_io_engine.write(drive_i, sector_i, data, 1))
+            return drive_i;
+        return -1;
+    }
+
+    // Parity is among "OK" drives, get original data of dead drive before calculating new parity
+    count_path(PATH_DEGRADED_SECTORS);
+    INT_SECTOR_BUFFER(dead_drive_data) = {};
+    if ((failed_drive = xor_read_without_sector(dead_drive_data, failed_drive_i, sector_i)) >= 0)
+        return failed_drive;
+
+    // Write new data to OK sector
+    if (!m_io_engine.write(drive_i, sector_i, data, 1))
+        return drive_i;
+
+    // Calculate new parity sector of another "OK" drive
+    INT_SECTOR_BUFFER(new_parity_buffer) = {};
+    if ((failed_drive = xor_get_parity_supplement_dead_sector(new_parity_buffer, parity_drive_i, failed_drive_i,
+                                                              dead_drive_data, sector_i)) >= 0)
+        return failed_drive;
+
+    // Write newly calculated parity to "OK" drive
+    if (!m_io_engine.write(parity_drive_i, sector_i, new_parity_buffer, 1))
+        return parity_drive_i;
+
+    return -1;
+}
+
+int CRaidVolume::failed_drive_at(const int sector_i) const {
+    if (m_status != RAID_DEGRADED || sector_i < m_resync_watermark)
+        return -1;
+    // Drives added by a reshape aren't members of rows which aren't restriped yet
+    const int drive_cnt = row_geometry(sector_i).m_devices;
+    const int failed_drive_i = m_failed_drive_i;
+    const int second_failed_drive_i = m_second_failed_drive_i;
+    if (failed_drive_i >= 0 && failed_drive_i < drive_cnt)
+        return failed_drive_i;
+    return second_failed_drive_i < drive_cnt ? second_failed_drive_i : -1;
+}
+
+bool CRaidVolume::drive_failed_at(const int drive_i, const int sector_i) const {
+    if (m_status != RAID_DEGRADED || sector_i < m_resync_watermark)
+        return false;
+    return drive_failed(drive_i);
+}
+
+bool CRaidVolume::drive_failed(const int drive_i) const {
+    return drive_i == m_failed_drive_i || drive_i == m_second_failed_drive_i;
+}
+
+int CRaidVolume::fail_drive(const int drive_i) {
+    int failed_drive_i = -1;
+
+    // First failure of a RAID_OK volume, other threads failing on the same drive only retry
+    if (m_failed_drive_i.compare_exchange_strong(failed_drive_i, drive_i)) {
+        m_metadata.m_degraded_timestamp = m_metadata.m_timestamp;
+        {
+            lock_guard<mutex> bitmap_lock(m_bitmap_mutex);
+            memset(m_bitmap, 0, SECTOR_SIZE);
+        }
+        m_row_cache.clear();
+        int expected_status = RAID_OK;
+        m_status.compare_exchange_strong(expected_status, RAID_DEGRADED);
+    } else if (failed_drive_i == drive_i || m_second_failed_drive_i == drive_i) {
+        // Drive being resynced failed again, rebuilt rows can't be trusted anymore
+        if (m_status == RAID_DEGRADED) {
+            m_resync_watermark = 0;
+            m_row_cache.clear();
+        }
+    } else if (m_geometry.m_parity_cnt == 2) {
+        // Second failure of a dual parity RAID, a running resync starts over to rebuild both drives
+        int second_failed_drive_i = -1;
+        if (m_second_failed_drive_i.compare_exchange_strong(second_failed_drive_i, drive_i)
+            || second_failed_drive_i == drive_i) {
+            m_resync_watermark = 0;
+            m_row_cache.clear();
+        } else {
+            m_status = RAID_FAILED;
+        }
+    } else {
+        m_status = RAID_FAILED;
+    }
+
+    // Hot spare takes the place of the failed drive, a failure during its rebuild restarts the rebuild
+    if (m_status == RAID_DEGRADED && m_metadata.m_spare_cnt > 0)
+        request_spare_rebuild();
+    return m_status;
+}
+
+int CRaidVolume::resync_loop(const bool requested) {
+    bool rebuild = requested;
+    while (true) {
+        {
+            // Drives are swapped with no I/O in flight
+            shared_lock<shared_mutex> layout_lock(m_layout_mutex);
+            CStripeLockGuard all_lock(m_stripe_locks, 0, STRIPE_LOCK_CNT - 1, true);
+            lock_guard<mutex> resync_lock(m_resync_mutex);
+
+            // Failed drives are rebuilt automatically only if a spare took their place (or they returned at start)
+            if (m_spare_rebuild_pending) {
+                m_spare_rebuild_pending = false;
+                bool spares_ready = true;
+                for (const int failed_drive_i : {m_failed_drive_i.load(), m_second_failed_drive_i.load()})
+                    if (failed_drive_i >= 0 && !(m_spare_rebuild_drives & (1u << failed_drive_i))
+                        && !replace_with_spare(failed_drive_i))
+                        spares_ready = false;
+                rebuild = rebuild || spares_ready;
+            }
+
+            if (!rebuild || m_resync_cancel || m_status != RAID_DEGRADED) {
+                m_resync_running = false;
+                m_resync_done.notify_all();
+                return m_status;
+            }
+        }
+
+        rebuild = false;
+        resync_rows();
+    }
+}
+
+void CRaidVolume::request_spare_rebuild() {
+    lock_guard<mutex> resync_lock(m_resync_mutex);
+    if (m_resync_cancel)
+        return;
+    m_spare_rebuild_pending = true;
+
+    // Running resync rebuilds onto the spares once it returns
+    if (m_resync_running)
+        return;
+    if (m_resync_thread.joinable())
+        m_resync_thread.join();
+    m_resync_running = true;
+    m_resync_thread = thread(&CRaidVolume::resync_loop, this, false);
+}
+
+bool CRaidVolume::replace_with_spare(const int drive_i) {
+    for (int spare_i = m_geometry.m_devices; spare_i < m_dev->m_Devices; spare_i++) {
+        if (m_metadata.m_failed_spares & (1 << spare_i))
+            continue;
+
+        // Spare serves the failed drive index from now on, the failed TBlkDev drive is parked at the spare index
+        m_resync_watermark = 0;
+        swap(m_metadata.m_drive_devices[drive_i], m_metadata.m_drive_devices[spare_i]);
+        m_metadata.m_failed_spares |= 1 << spare_i;
+        m_io_engine.map_drive(drive_i, m_metadata.m_drive_devices[drive_i]);
+        m_io_engine.map_drive(spare_i, m_metadata.m_drive_devices[spare_i]);
+        m_spare_rebuild_drives |= 1u << drive_i;
+
+        // Spare holds none of the rows, all regions are rebuilt (also after a restart), a drive failing the bitmap
+        // write is noticed by the next row I/O
+        lock_guard<mutex> bitmap_lock(m_bitmap_mutex);
+        memset(m_bitmap, 0xff, SECTOR_SIZE);
+        bitmap_write();
+        return true;
+    }
+    return false;
+}
+
+const CRaidGeometry &CRaidVolume::stripe_geometry(const int stripe_i) const {
+    return stripe_i < m_reshape_stripe ? m_geometry : m_reshape_geometry;
+}
+
+const CRaidGeometry &CRaidVolume::row_geometry(const int sector_i) const {
+    return stripe_geometry(sector_i / m_geometry.m_chunk_sectors);
+}
+
+int CRaidVolume::row_layout_end(const int sector_i) const {
+    const int reshape_row = m_reshape_stripe * m_geometry.m_chunk_sectors;
+    return sector_i < reshape_row ? reshape_row : m_row_cnt;
 }
 
-CRaidVolume::~CRaidVolume() {
-    clear_raid_volume_data();
+const CRaidGeometry &CRaidVolume::sector_geometry(const int raid_sector, int &layout_first, int &layout_end) const {
+    if (raid_sector < m_reshape_sector) {
+        layout_first = 0;
+        layout_end = m_reshape_sector;
+        return m_geometry;
+    }
+    layout_first = m_reshape_sector;
+    layout_end = m_raid_size;
+    return m_reshape_geometry;
 }
 
-bool CRaidVolume::create(const TBlkDev &dev) {
-    if (!validate_t_blk_dev(dev))
-        return false;
+const CRaidGeometry &CRaidVolume::sector_geometry(const int raid_sector) const {
+    return raid_sector < m_reshape_sector ? m_geometry : m_reshape_geometry;
+}
 
-    // Check if sector_size is too small for metadata
-    if constexpr (SECTOR_SIZE < sizeof(CDriveMetadata))
+bool CRaidVolume::reshape_begin(const TBlkDev &dev) {
+    const int device_cnt = m_dev->m_Devices;
+    const int added_cnt = dev.m_Devices - device_cnt;
+    if (!validate_t_blk_dev(dev) || dev.m_Sectors != m_dev->m_Sectors || added_cnt < 1)
         return false;
 
-    // Create stack int buffer
-    INT_SECTOR_BUFFER(buffer);
-    memset(&buffer, 0, SECTOR_SIZE);
-
-    buffer[TIMESTAMP_INDEX] = 0;
-    buffer[FAILED_DRIVE_INDEX] = -1;
+    // Journal transactions have to hold a whole stripe of the grown layout, the backup area has to fit the added
+    // drives
+    const CRaidGeometry geometry(m_geometry.m_devices + added_cnt, m_geometry.m_chunk_sectors,
+                                 m_geometry.m_parity_cnt);
+    const int backup_rows = (geometry.stripe_sector_cnt() + added_cnt - 1) / added_cnt;
+    if ((m_journal_sectors > 0 && m_journal_sectors <= geometry.stripe_sector_cnt())
+        || (m_geometry.data_drive_cnt() + added_cnt - 1) / added_cnt * geometry.m_chunk_sectors + backup_rows
+               > m_row_cnt)
+        return false;
 
-    // Try write default metadata to all drives
-    const int metadata_sector_i = dev.m_Sectors - 1;
-    for (int dev_i = 0; dev_i < dev.m_Devices; dev_i++)
-        if (dev.m_Write(dev_i, metadata_sector_i, &buffer, 1) != 1)
+    // Added drives get an empty journal & bitmap like create() writes them, metadata follows with the checkpoint
+    INT_SECTOR_BUFFER(bitmap_buffer) = {};
+    const vector<int> journal_buffer(min(m_journal_sectors, RESYNC_BATCH_ROWS) * (SECTOR_SIZE / sizeof(int)));
+    for (int dev_i = device_cnt; dev_i < dev.m_Devices; dev_i++) {
+        for (int sector_i = m_journal_first_sector; sector_i < m_bitmap_sector; sector_i += RESYNC_BATCH_ROWS) {
+            const int sector_cnt = min(RESYNC_BATCH_ROWS, m_bitmap_sector - sector_i);
+            if (dev.m_Write(dev_i, sector_i, journal_buffer.data(), sector_cnt) != sector_cnt)
+                return false;
+        }
+        if (dev.m_Write(dev_i, m_bitmap_sector, &bitmap_buffer, 1) != 1)
             return false;
+    }
 
-    return true;
-}
-
-int CRaidVolume::start(const TBlkDev &dev) {
-    // RAID volume was not stopped before calling start
-    if (m_dev != nullptr || !validate_t_blk_dev(dev))
-        return RAID_FAILED;
+    // Cached stripes are written in the old layout, stripes aren't cached until the reshape finishes
+    if (!flush_write_cache())
+        return false;
+    m_write_cache.configure(0, m_geometry.stripe_sector_cnt());
 
-    // Initialize RAID, Copy TBlkDev
-    m_dev = new TBlkDev;
     m_dev->m_Devices = dev.m_Devices;
-    m_dev->m_Sectors = dev.m_Sectors;
     m_dev->m_Read = dev.m_Read;
     m_dev->m_Write = dev.m_Write;
+    m_io_engine.add_drives(*m_dev);
+    m_metadata.m_device_cnt = dev.m_Devices;
 
-    // Assume RAID_OK before checking metadata
-    m_status = RAID_OK;
-    // Calculate raid size
-    const int usable_sector_count = m_dev->m_Devices * (m_dev->m_Sectors - 1); // Number of non metadata sectors
-    m_raid_size = usable_sector_count - (m_dev->m_Sectors - 1); // Subtract parity sectors - aka one for each line
-    // Initialize metadata sector & m_drives_metadata array
-    m_metadata_sector = m_dev->m_Sectors - 1;
+    // Added drives take the drive indices following the member drives, hot spares move past them
+    for (int spare_i = device_cnt - 1; spare_i >= m_geometry.m_devices; spare_i--)
+        m_metadata.m_drive_devices[spare_i + added_cnt] = m_metadata.m_drive_devices[spare_i];
+    for (int added_i = 0; added_i < added_cnt; added_i++)
+        m_metadata.m_drive_devices[m_geometry.m_devices + added_i] = device_cnt + added_i;
+    m_metadata.m_failed_spares <<= added_cnt;
+    for (int drive_i = 0; drive_i < m_dev->m_Devices; drive_i++)
+        m_io_engine.map_drive(drive_i, m_metadata.m_drive_devices[drive_i]);
 
-    m_metadata.m_failed_drive_i = -1;
-    m_metadata.m_timestamp = m_buffer[1];
+    // All stripes are served by the old layout until restriped
+    m_reshape_geometry = m_geometry;
+    m_geometry = geometry;
+    m_reshape_stripe = 0;
+    m_reshape_sector = 0;
+    m_metadata.m_reshape_devices = m_reshape_geometry.m_devices;
+    m_metadata.m_reshape_stripe = 0;
+    m_metadata.m_reshape_backup_stripe = -1;
+    return write_reshape_metadata() != RAID_FAILED;
+}
 
-    // Metadata read buffer
-    INT_SECTOR_BUFFER(read_buffer);
+bool CRaidVolume::reshape_batch() {
+    if (m_status != RAID_OK)
+        return false;
 
-    int timestamps[3];
-    int failed_drives[3];
-    int read_failed_cnt = 0;
-    int read_failed_drive = -1;
+    const int chunk_sectors = m_geometry.m_chunk_sectors;
+    const int stripe_sector_cnt = m_geometry.stripe_sector_cnt();
+    const int stripe_i = m_reshape_stripe;
+    // Stripes past the old data are restriped as well, their rows still hold blocks of the old layout & parity
+    // which doesn't match the zeroed data they expose once the RAID grows
+    const int final_stripe = m_row_cnt / chunk_sectors;
+    // Rows of a batch may only hold old data of stripes restriped before it, which is served by the grown layout
+    // even if the checkpoint past the batch doesn't reach the drives
+    const int stripe_end_max = static_cast<int>(static_cast<long long>(stripe_i) * m_geometry.data_drive_cnt()
+                                                / m_reshape_geometry.data_drive_cnt());
+    const bool backup = stripe_end_max <= stripe_i;
+    const int stripe_end =
+        backup ? stripe_i + 1
+               : min({stripe_end_max, stripe_i + max(1, RESHAPE_BATCH_ROWS / chunk_sectors), final_stripe});
 
-    // Load metadata from first three drives
-    for (int dev_i = 0; dev_i < 3; dev_i++) {
-        if (m_dev->m_Read(dev_i, m_metadata_sector, &read_buffer, 1) != 1) {
-            read_failed_drive = dev_i;
-            read_failed_cnt++;
-            continue;
+    // Raid data past the old size is zero
+    const int sector_i = stripe_i * stripe_sector_cnt;
+    const int sector_end = min(stripe_end * stripe_sector_cnt, m_raid_size.load());
+    vector<int> batch_buffer((stripe_end - stripe_i) * stripe_sector_cnt * (SECTOR_SIZE / sizeof(int)), 0);
+    if (sector_end > sector_i && !read_sectors(sector_i, batch_buffer.data(), sector_end - sector_i))
+        return false;
+
+    // Stripe overwrites old data it holds itself, a copy is kept in the backup area until the checkpoint passes it
+    if (backup) {
+        CDriveIo backup_ios[MAX_RAID_DEVICES];
+        const int backup_io_cnt = reshape_backup_ios(batch_buffer.data(), true, backup_ios);
+        int failed_drive = -1;
+        if ((failed_drive = m_io_engine.execute(backup_ios, backup_io_cnt)) >= 0) {
+            fail_drive(failed_drive);
+            return false;
         }
-        timestamps[dev_i] = read_buffer[TIMESTAMP_INDEX];
-        failed_drives[dev_i] = read_buffer[FAILED_DRIVE_INDEX];
+        m_metadata.m_reshape_backup_stripe = stripe_i;
+        if (write_reshape_metadata() != RAID_OK)
+            return false;
     }
 
-    // There was one read failure
-    if (read_failed_cnt == 1) {
-        auto other_a = (read_failed_drive + 1) % 3;
-        auto other_b = (read_failed_drive + 2) % 3;
-
-        // Timestamps of other two successfully read drives dont match
-        if (timestamps[other_a] != timestamps[other_b]) {
-            m_status = RAID_FAILED;
-            return m_status;
-        }
+    if (!reshape_write_stripes(batch_buffer.data(), stripe_i, stripe_end - stripe_i))
+        return false;
+    m_metadata.m_reshape_stripe = stripe_end;
+    m_metadata.m_reshape_backup_stripe = -1;
+    return write_reshape_metadata() != RAID_FAILED;
+}
 
-        // There was no known failed drive when shutting down
-        if (failed_drives[other_a] < 0) {
-            m_status = RAID_DEGRADED;
-            m_metadata.m_failed_drive_i = read_failed_drive;
-            m_metadata.m_timestamp = timestamps[other_a];
-            return m_status;
-        }
+bool CRaidVolume::reshape_restore_backup() {
+    const int stripe_i = m_reshape_stripe;
+    vector<int> stripe_buffer(m_geometry.stripe_sector_cnt() * (SECTOR_SIZE / sizeof(int)));
+    CDriveIo backup_ios[MAX_RAID_DEVICES];
+    const int backup_io_cnt = reshape_backup_ios(stripe_buffer.data(), false, backup_ios);
 
-        // Timestamps match but drives know another failed drive
-        m_status = RAID_FAILED;
-        return m_status;
-    }
-    if (read_failed_cnt == 0) {
-        if (timestamps[0] != timestamps[1] && timestamps[1] != timestamps[2] && timestamps[0] != timestamps[2]) {
-            // All timestamps are different - raid must have at least 2 failed drives
-            m_status = RAID_FAILED;
-            return m_status;
-        }
-        if (timestamps[0] == timestamps[1] && timestamps[1] == timestamps[2]) {
-            // All timestamps match, set metadata
-            m_metadata.m_timestamp = timestamps[0];
-            m_metadata.m_failed_drive_i = failed_drives[0];
-            if (m_metadata.m_failed_drive_i == -1)
-                m_status = RAID_OK;
-            else
-                m_status = RAID_DEGRADED;
-        } else if (timestamps[0] == timestamps[1] && failed_drives[0] == 2) {
-            // Third drive failed
-            m_metadata.m_timestamp = timestamps[0];
-            m_metadata.m_failed_drive_i = 2;
-            m_status = RAID_DEGRADED;
-        } else if (timestamps[0] == timestamps[2] && failed_drives[0] == 1) {
-            // Second drive failed
-            m_metadata.m_timestamp = timestamps[0];
-            m_metadata.m_failed_drive_i = 1;
-            m_status = RAID_DEGRADED;
-        } else if (timestamps[1] == timestamps[2] && failed_drives[1] == 0) {
-            // First drive failed
-            m_metadata.m_timestamp = timestamps[1];
-            m_metadata.m_failed_drive_i = 0;
-            m_status = RAID_DEGRADED;
-        } else {
-            // Timestamp is different while OK drives say another drive is faulty
-            m_status = RAID_FAILED;
-            return m_status;
-        }
-    } else {
+    // Copy on a drive which missed updates can't be trusted
+    bool readable = true;
+    for (int io_i = 0; io_i < backup_io_cnt; io_i++)
+        readable = readable && !drive_failed(backup_ios[io_i].m_drive_i);
+    if (!readable || m_io_engine.execute(backup_ios, backup_io_cnt) >= 0) {
         m_status = RAID_FAILED;
-        return m_status;
+        return false;
     }
 
-    return m_status;
+    if (!reshape_write_stripes(stripe_buffer.data(), stripe_i, 1))
+        return false;
+    m_metadata.m_reshape_stripe = stripe_i + 1;
+    m_metadata.m_reshape_backup_stripe = -1;
+    return write_reshape_metadata() != RAID_FAILED;
 }
 
-int CRaidVolume::stop() {
-    if (m_status == RAID_STOPPED || m_status == RAID_FAILED)
-        return m_status = RAID_STOPPED;
+bool CRaidVolume::reshape_write_stripes(const int *stripe_data, const int stripe_i, const int stripe_cnt) {
+    const int first_row = stripe_i * m_geometry.m_chunk_sectors;
+    const int row_cnt = stripe_cnt * m_geometry.m_chunk_sectors;
+    // Stripes are served by the grown layout from now on, the checkpoint past them is persisted by the caller
+    m_reshape_stripe = stripe_i + stripe_cnt;
+    m_reshape_sector = m_reshape_stripe * m_geometry.stripe_sector_cnt();
+    int failed_drive = -1;
+    do {
+        // Record the write of degraded rows before writing them, see write_stripe()
+        failed_drive = m_status == RAID_DEGRADED ? bitmap_mark_rows(first_row, row_cnt) : -1;
+        if (failed_drive < 0)
+            failed_drive = write_full_stripes(stripe_data, stripe_i, stripe_cnt);
+    } while (failed_drive >= 0 && fail_drive(failed_drive) != RAID_FAILED);
 
-    // Increment current metadata timestamp
-    m_metadata.m_timestamp += 1;
+    m_row_cache.invalidate(first_row, row_cnt);
+    return m_status != RAID_FAILED;
+}
 
-    // Load metadata to m_buffer
-    memset(&m_buffer, 0, SECTOR_SIZE);
-    m_buffer[FAILED_DRIVE_INDEX] = m_metadata.m_failed_drive_i;
-    m_buffer[TIMESTAMP_INDEX] = m_metadata.m_timestamp;
+void CRaidVolume::reshape_finish() {
+    m_reshape_stripe = m_row_cnt / m_geometry.m_chunk_sectors;
+    m_raid_size = m_geometry.data_drive_cnt() * m_row_cnt;
+    m_reshape_sector = m_raid_size;
+    m_reshape_geometry = {};
+    m_metadata.m_reshape_devices = 0;
+    m_metadata.m_reshape_stripe = 0;
+    m_metadata.m_reshape_backup_stripe = -1;
+    if (write_reshape_metadata() == RAID_FAILED)
+        return;
+    m_write_cache.configure(m_write_back_stripes, m_geometry.stripe_sector_cnt());
+}
 
-    // Write metadata information to all drives
-    for (int dev_i = 0; dev_i < m_dev->m_Devices; dev_i++) {
-        if (m_dev->m_Write(dev_i, m_metadata_sector, &m_buffer, 1) == 1)
-            continue;
+int CRaidVolume::reshape_backup_ios(int *data, const bool write, CDriveIo ios[MAX_RAID_DEVICES]) const {
+    const int added_cnt = m_geometry.m_devices - m_reshape_geometry.m_devices;
+    const int stripe_sector_cnt = m_geometry.stripe_sector_cnt();
+    const int drive_rows = (stripe_sector_cnt + added_cnt - 1) / added_cnt;
+    int io_cnt = 0;
+    for (int sector_i = 0; sector_i < stripe_sector_cnt; sector_i += drive_rows) {
+        CDriveIo &io = ios[io_cnt];
+        io.m_drive_i = m_reshape_geometry.m_devices + io_cnt;
+        io.m_sector_i = reshape_backup_row();
+        io.m_sector_cnt = min(drive_rows, stripe_sector_cnt - sector_i);
+        if (write)
+            io.m_write_buffer = data + sector_i * (SECTOR_SIZE / sizeof(int));
+        else
+            io.m_read_buffer = data + sector_i * (SECTOR_SIZE / sizeof(int));
+        io_cnt++;
+    }
+    return io_cnt;
+}
 
-        // Skip trying to correct writing to a degraded drive or a failed RAID
-        if (m_metadata.m_failed_drive_i == dev_i)
-            continue;
+int CRaidVolume::reshape_backup_row() const {
+    // Stripes restriped with a backup are those below ceil(old data drives / added drives)
+    const int added_cnt = m_geometry.m_devices - m_reshape_geometry.m_devices;
+    return (m_reshape_geometry.data_drive_cnt() + added_cnt - 1) / added_cnt * m_geometry.m_chunk_sectors;
+}
 
-        // Raid degraded while stopping, rewrite buffer info
-        if (m_status == RAID_OK) {
-            m_metadata.m_failed_drive_i = dev_i;
-            m_status = RAID_DEGRADED;
-            m_buffer[FAILED_DRIVE_INDEX] = m_metadata.m_failed_drive_i;
-            dev_i = 0;
-            continue;
-        }
+int CRaidVolume::write_reshape_metadata() {
+    INT_SECTOR_BUFFER(metadata_buffer);
+    bool written = false;
+    while (!written) {
+        m_metadata.m_failed_drive_i = m_failed_drive_i;
+        m_metadata.m_second_failed_drive_i = m_second_failed_drive_i;
+        m_metadata.m_timestamp += 1;
+        metadata_to_buffer(m_metadata, metadata_buffer);
 
-        // RAID failed while stopping, rewrite metadata without checking
-        if (m_status == RAID_DEGRADED) {
-            m_status = RAID_FAILED;
-            dev_i = 0;
+        // Drive which misses the update is failed & the others are written again with it
+        // Added drives are written first, an added drive without a superblock is a failed drive at start()
+        written = true;
+        for (int drive_i = m_dev->m_Devices - 1; written && drive_i >= 0; drive_i--) {
+            if (drive_failed(drive_i) || (m_metadata.m_failed_spares & (1 << drive_i)))
+                continue;
+            if (m_io_engine.write(drive_i, m_metadata_sector, metadata_buffer, 1))
+                continue;
+            written = false;
+            if (drive_i >= m_geometry.m_devices) {
+                m_metadata.m_failed_spares |= 1 << drive_i;
+                continue;
+            }
+            if (fail_drive(drive_i) == RAID_FAILED)
+                return m_status;
+            // Drive only missed this metadata update, see stop()
+            if (m_failed_drive_i == drive_i)
+                m_metadata.m_degraded_timestamp = m_metadata.m_timestamp - 1;
         }
     }
-
-    // Clear CRaidVolume data
-    clear_raid_volume_data();
-
     return m_status;
 }
 
-int CRaidVolume::resync() {
-    if (m_status == RAID_OK || m_status == RAID_FAILED || m_status == RAID_STOPPED)
-        return m_status;
+int CRaidVolume::resync_rows() {
+    const int row_cnt = m_row_cnt;
+    const int chunk_sectors = m_geometry.m_chunk_sectors;
+    // Drives being rebuilt, both failed drives of a dual parity RAID are rebuilt together
+    const int rebuilt_drives[2] = {m_failed_drive_i, m_second_failed_drive_i};
+    const int rebuilt_cnt = rebuilt_drives[1] >= 0 ? 2 : 1;
+    // Returning drives only miss rows of marked regions
+    const bool bitmap_resync = bitmap_resync_possible();
 
-    INT_SECTOR_BUFFER(restore_buffer) = {};
+    // Batches consist of whole stripes, so the watermark never splits a stripe
+    const int batch_rows = max(1, RESYNC_BATCH_ROWS / chunk_sectors) * chunk_sectors;
+    // Batch buffer, one run of batch_rows sectors per drive, runs of rebuilt drives are reconstructed
+    vector<int> batch_buffer(m_geometry.m_devices * batch_rows * (SECTOR_SIZE / sizeof(int)));
 
-    for (int sector_i = 0; sector_i < (m_dev->m_Sectors - 1); sector_i++) {
+    m_resync_watermark = 0;
 
-        // Get original drive data from parity
-        if (xor_read_without_sector(restore_buffer, m_metadata.m_failed_drive_i, sector_i) >= 0) {
-            // One of other drives failed while restoring data
-            m_status = RAID_FAILED;
+    int batch_cnt = 0;
+    for (int batch_i = 0; batch_i < row_cnt; batch_i += batch_cnt) {
+        // Batch is rebuilt in one layout, it doesn't cross the restriped stripes of a reshape in progress
+        shared_lock<shared_mutex> layout_lock(m_layout_mutex);
+        const CRaidGeometry &geometry = row_geometry(batch_i);
+        batch_cnt = min(batch_rows, row_layout_end(batch_i) - batch_i);
+        CStripeLockGuard batch_lock(m_stripe_locks, batch_i / chunk_sectors, (batch_i + batch_cnt - 1) / chunk_sectors,
+                                    true);
+
+        // Stopped, or a drive being resynced failed again
+        if (m_resync_cancel || m_status != RAID_DEGRADED || m_resync_watermark != batch_i) {
             return m_status;
         }
 
-        // Try write data to the possibly OK degraded drive
-        if (m_dev->m_Write(m_metadata.m_failed_drive_i, sector_i, restore_buffer, 1) != 1) {
-            m_status = RAID_DEGRADED;
+        int run_cnt = 0;
+        int watermark = batch_i;
+
+        // Rows weren't written since the drive failed
+        if (bitmap_resync && !bitmap_marked(batch_i, batch_cnt)) {
+            if (!m_resync_watermark.compare_exchange_strong(watermark, batch_i + batch_cnt)) {
+                return m_status;
+            }
+            m_row_cache.invalidate(batch_i, batch_cnt);
+            continue;
+        }
+
+        // Read row batch of all other drives in parallel
+        CDriveIo run_ios[MAX_RAID_DEVICES];
+        for (int drive_i = 0; drive_i < geometry.m_devices; drive_i++) {
+            if (drive_i == rebuilt_drives[0] || drive_i == rebuilt_drives[1])
+                continue;
+            run_ios[run_cnt].m_drive_i = drive_i;
+            run_ios[run_cnt].m_sector_i = batch_i;
+            run_ios[run_cnt].m_sector_cnt = batch_cnt;
+            run_ios[run_cnt].m_read_buffer = batch_buffer.data() + drive_i * batch_rows * (SECTOR_SIZE / sizeof(int));
+            run_cnt++;
+        }
+
+        // One of other drives failed while restoring data
+        int failed_drive = -1;
+        if ((failed_drive = m_io_engine.execute(run_ios, run_cnt)) >= 0) {
+            fail_drive(failed_drive);
+            return m_status;
+        }
+
+        // Get original drive data from parity, blocks of a stripe are runs of its chunk_sectors rows
+        for (int stripe_row = 0; stripe_row < batch_cnt; stripe_row += chunk_sectors) {
+            int drives[MAX_RAID_DEVICES];
+            geometry.stripe_drives_of(batch_i + stripe_row, drives);
+            void *blocks[MAX_RAID_DEVICES];
+            int lost[2] = {-1, -1};
+            int lost_cnt = 0;
+            for (int block_i = 0; block_i < geometry.m_devices; block_i++) {
+                blocks[block_i] =
+                    batch_buffer.data() + (drives[block_i] * batch_rows + stripe_row) * (SECTOR_SIZE / sizeof(int));
+                if (drives[block_i] == rebuilt_drives[0] || drives[block_i] == rebuilt_drives[1])
+                    lost[lost_cnt++] = block_i;
+            }
+            if (lost_cnt > 0)
+                CGfKernel::recover(blocks, geometry.data_drive_cnt(), lost[0], lost[1], chunk_sectors * SECTOR_SIZE);
+        }
+
+        // Try write data to the possibly OK degraded drives, drives added by a reshape have no rows to rebuild in
+        // stripes which aren't restriped yet
+        CDriveIo rebuild_ios[2];
+        int rebuild_io_cnt = 0;
+        for (int rebuilt_i = 0; rebuilt_i < rebuilt_cnt; rebuilt_i++) {
+            if (rebuilt_drives[rebuilt_i] >= geometry.m_devices)
+                continue;
+            CDriveIo &io = rebuild_ios[rebuild_io_cnt++];
+            io.m_drive_i = rebuilt_drives[rebuilt_i];
+            io.m_sector_i = batch_i;
+            io.m_sector_cnt = batch_cnt;
+            io.m_write_buffer =
+                batch_buffer.data() + rebuilt_drives[rebuilt_i] * batch_rows * (SECTOR_SIZE / sizeof(int));
+        }
+        const int failed_rebuilt_drive = m_io_engine.execute(rebuild_ios, rebuild_io_cnt);
+        if (failed_rebuilt_drive >= 0) {
+            m_resync_watermark = 0;
+            // Drive which can't be written is replaced by a hot spare
+            if (m_metadata.m_spare_cnt > 0) {
+                lock_guard<mutex> resync_lock(m_resync_mutex);
+                m_spare_rebuild_drives &= ~(1u << failed_rebuilt_drive);
+                m_spare_rebuild_pending = true;
+            }
+            return m_status;
+        }
+
+        // Rows up to the batch end are now served from the replaced drives, unless a failure of a drive reset the
+        // watermark meanwhile
+        if (!m_resync_watermark.compare_exchange_strong(watermark, batch_i + batch_cnt)) {
             return m_status;
         }
+        m_row_cache.invalidate(batch_i, batch_cnt);
     }
 
-    // Write new metadata to drives
-    memset(restore_buffer, 0, SECTOR_SIZE);
-    restore_buffer[TIMESTAMP_INDEX] = m_metadata.m_timestamp;
-    restore_buffer[FAILED_DRIVE_INDEX] = -1;
+    // Status & failed drives change with no I/O in flight, a failure after the last batch reset the watermark
+    shared_lock<shared_mutex> layout_lock(m_layout_mutex);
+    CStripeLockGuard all_lock(m_stripe_locks, 0, STRIPE_LOCK_CNT - 1, true);
+    const bool rebuilt = m_resync_watermark == row_cnt;
+    m_resync_watermark = 0;
 
-    // Writing metadata to replaced drive failed
-    if(m_dev->m_Write(m_metadata.m_failed_drive_i, m_metadata_sector, restore_buffer, 1) != 1) {
-        m_status = RAID_DEGRADED;
+    if (m_status != RAID_DEGRADED || !rebuilt)
         return m_status;
+
+    // Write cleared bitmap & new metadata to drives
+    INT_SECTOR_BUFFER(metadata_buffer);
+    INT_SECTOR_BUFFER(bitmap_buffer) = {};
+    CDriveMetadata metadata = m_metadata;
+    metadata.m_failed_drive_i = -1;
+    metadata.m_second_failed_drive_i = -1;
+    metadata_to_buffer(metadata, metadata_buffer);
+
+    // Replaced drives may hold journal transactions of another RAID, clear their journal areas
+    memset(batch_buffer.data(), 0, batch_rows * SECTOR_SIZE);
+    for (int rebuilt_i = 0; rebuilt_i < rebuilt_cnt; rebuilt_i++) {
+        const int rebuilt_drive_i = rebuilt_drives[rebuilt_i];
+        for (int sector_i = m_journal_first_sector; sector_i < m_bitmap_sector; sector_i += batch_rows) {
+            const int sector_cnt = min(batch_rows, m_bitmap_sector - sector_i);
+            if (!m_io_engine.write(rebuilt_drive_i, sector_i, batch_buffer.data(), sector_cnt))
+                return m_status;
+        }
+
+        // Writing metadata to replaced drive failed
+        if (!m_io_engine.write(rebuilt_drive_i, m_bitmap_sector, bitmap_buffer, 1)
+            || !m_io_engine.write(rebuilt_drive_i, m_metadata_sector, metadata_buffer, 1))
+            return m_status;
     }
 
-    for (int dev_i = 0; dev_i < m_dev->m_Devices; dev_i++) {
-        if(dev_i == m_metadata.m_failed_drive_i)
+    for (int dev_i = 0; dev_i < m_geometry.m_devices; dev_i++) {
+        if (dev_i == rebuilt_drives[0] || dev_i == rebuilt_drives[1])
             continue;
-        if(m_dev->m_Write(dev_i, m_metadata_sector, restore_buffer, 1) != 1) {
-            m_status = RAID_DEGRADED;
-            m_metadata.m_failed_drive_i = dev_i;
+        if (!m_io_engine.write(dev_i, m_bitmap_sector, bitmap_buffer, 1)
+            || !m_io_engine.write(dev_i, m_metadata_sector, metadata_buffer, 1)) {
+            // Replaced drives are complete, the other drive failed instead
+            {
+                lock_guard<mutex> bitmap_lock(m_bitmap_mutex);
+                m_row_cache.clear();
+                m_failed_drive_i = dev_i;
+                m_second_failed_drive_i = -1;
+                m_metadata.m_degraded_timestamp = m_metadata.m_timestamp;
+                memset(m_bitmap, 0, SECTOR_SIZE);
+            }
+            if (m_metadata.m_spare_cnt > 0) {
+                {
+                    lock_guard<mutex> resync_lock(m_resync_mutex);
+                    m_spare_rebuild_drives = 0;
+                }
+                request_spare_rebuild();
+            }
             return m_status;
         }
     }
 
-    m_metadata.m_failed_drive_i = -1;
+    // Spares only keep metadata, a spare which can't be written isn't used
+    for (int spare_i = m_geometry.m_devices; spare_i < m_dev->m_Devices; spare_i++)
+        if (!(m_metadata.m_failed_spares & (1 << spare_i))
+            && !m_io_engine.write(spare_i, m_metadata_sector, metadata_buffer, 1))
+            m_metadata.m_failed_spares |= 1 << spare_i;
+
+    lock_guard<mutex> resync_lock(m_resync_mutex);
+    m_spare_rebuild_drives = 0;
+    lock_guard<mutex> bitmap_lock(m_bitmap_mutex);
+    memset(m_bitmap, 0, SECTOR_SIZE);
+    m_row_cache.clear();
     m_status = RAID_OK;
+    m_failed_drive_i = -1;
+    m_second_failed_drive_i = -1;
     return m_status;
 }
 
-int CRaidVolume::status() const {
-    return m_status;
-}
+int CRaidVolume::bitmap_mark(const int sector_i) {
+    const int region_i = sector_i / m_bitmap_region_rows;
+    const unsigned char region_bit = 1u << (region_i % 8);
+    lock_guard<mutex> bitmap_lock(m_bitmap_mutex);
 
-int CRaidVolume::size() const {
-    return m_raid_size;
-}
+    if (m_bitmap[region_i / 8] & region_bit)
+        return -1;
+    m_bitmap[region_i / 8] |= region_bit;
 
-bool CRaidVolume::read(int secNr, void *data, int secCnt) {
-    // Read buffer nullptr or Invalid starting raid sector
-    if (!data || secCnt < 0 || secCnt > (m_raid_size - 1) || m_status == RAID_FAILED)
-        return false;
+    // Bitmap has to be on drives before the row write it describes
+    return bitmap_write();
+}
 
-    auto cast_data = static_cast<int *>(data);
+int CRaidVolume::bitmap_mark_rows(const int sector_i, const int sector_cnt) {
+    int failed_drive = -1;
+    for (int region_sector = sector_i / m_bitmap_region_rows * m_bitmap_region_rows;
+         region_sector < sector_i + sector_cnt; region_sector += m_bitmap_region_rows)
+        if ((failed_drive = bitmap_mark(region_sector)) >= 0)
+            return failed_drive;
+    return -1;
+}
 
-    for (int raid_i = secNr; raid_i < (secNr + secCnt); raid_i++) {
-        // Reading past existing raid sectors
-        if (raid_i >= m_raid_size)
-            return false;
+int CRaidVolume::bitmap_write() {
+    CDriveIo bitmap_ios[MAX_RAID_DEVICES];
+    int bitmap_io_cnt = 0;
+    for (int drive_i = 0; drive_i < m_geometry.m_devices; drive_i++) {
+        if (drive_failed(drive_i))
+            continue;
+        CDriveIo &io = bitmap_ios[bitmap_io_cnt++];
+        io.m_drive_i = drive_i;
+        io.m_sector_i = m_bitmap_sector;
+        io.m_sector_cnt = 1;
+        io.m_write_buffer = m_bitmap;
+    }
+    return m_io_engine.execute(bitmap_ios, bitmap_io_cnt);
+}
 
-        // Translate raid index to "physical" drive/sector/parity_drive indices
-        int drive_i = 0;
-        int drive_sector_i = 0;
-        int parity_drive_i = 0;
-        raid_sector_to_physical(raid_i, drive_i, drive_sector_i, parity_drive_i);
-
-        // Try read data from "FAIL" drive - use parity
-        if (m_status == RAID_DEGRADED && m_metadata.m_failed_drive_i == drive_i) {
-            if (xor_read_without_sector(cast_data, drive_i, drive_sector_i) >= 0) {
-                // Reading using parity failed, 2+ drives failed, raid failed
-                m_status = RAID_FAILED;
-                return false;
-            }
-        }
+bool CRaidVolume::bitmap_marked(const int sector_i, const int sector_cnt) const {
+    const int last_region_i = (sector_i + sector_cnt - 1) / m_bitmap_region_rows;
+    lock_guard<mutex> bitmap_lock(m_bitmap_mutex);
+    for (int region_i = sector_i / m_bitmap_region_rows; region_i <= last_region_i; region_i++)
+        if (m_bitmap[region_i / 8] & (1u << (region_i % 8)))
+            return true;
+    return false;
+}
 
-        // Try read data from "OK" drive in degraded state
-        else if (m_status == RAID_DEGRADED && m_metadata.m_failed_drive_i != drive_i) {
-            if (m_dev->m_Read(drive_i, drive_sector_i, cast_data, 1) != 1) {
-                // Current drive failed in addition to other degraded drive
-                m_status = RAID_FAILED;
-                return false;
-            }
-        }
+void CRaidVolume::load_bitmap() {
+    for (int drive_i = 0; drive_i < m_geometry.m_devices; drive_i++) {
+        if (drive_failed(drive_i))
+            continue;
+        if (m_io_engine.read(drive_i, m_bitmap_sector, m_bitmap, 1))
+            return;
+    }
 
-        // RAID must be RAID_OK, read
-        else if (m_dev->m_Read(drive_i, drive_sector_i, cast_data, 1) != 1) {
-            // Current drive failed, set raid to degraded state
-            m_status = RAID_DEGRADED;
-            m_metadata.m_failed_drive_i = drive_i;
+    // Unknown regions, whole drive has to be resynced
+    memset(m_bitmap, 0xff, SECTOR_SIZE);
+}
 
-            // Repeat read in degraded state
-            raid_i--;
+bool CRaidVolume::bitmap_resync_possible() const {
+    // Bitmap is cleared by the first failure only, so it covers the rows missed by a second failed drive as well
+    for (const int failed_drive_i : {m_failed_drive_i.load(), m_second_failed_drive_i.load()}) {
+        if (failed_drive_i < 0)
             continue;
-        }
-
-        // Increment buffer pointer
-        cast_data += (SECTOR_SIZE / sizeof(int));
+        INT_SECTOR_BUFFER(metadata_buffer);
+        CDriveMetadata metadata;
+        if (!m_io_engine.read(failed_drive_i, m_metadata_sector, metadata_buffer, 1))
+            return false;
+        // Replaced drive doesn't have metadata of this RAID
+        if (!metadata_from_buffer(metadata_buffer, metadata)
+            || memcmp(metadata.m_uuid, m_metadata.m_uuid, sizeof(m_metadata.m_uuid)) != 0
+            || metadata.m_timestamp < m_metadata.m_degraded_timestamp)
+            return false;
     }
-
     return true;
 }
 
-bool CRaidVolume::write(int secNr, const void *data, int secCnt) {
-    // Write buffer nullptr or Invalid starting raid sector
-    if (!data || secCnt < 0 || secCnt > (m_raid_size - 1) || m_status == RAID_FAILED)
+void CRaidVolume::metadata_to_buffer(const CDriveMetadata &metadata, INT_SECTOR_BUFFER(buffer)) {
+    memset(buffer, 0, SECTOR_SIZE);
+    buffer[FAILED_DRIVE_INDEX] = metadata.m_failed_drive_i;
+    buffer[TIMESTAMP_INDEX] = metadata.m_timestamp;
+    buffer[MAGIC_INDEX] = METADATA_MAGIC;
+    buffer[DEGRADED_TIMESTAMP_INDEX] = metadata.m_degraded_timestamp;
+    buffer[CHUNK_SECTORS_INDEX] = metadata.m_chunk_sectors;
+    buffer[JOURNAL_SECTORS_INDEX] = metadata.m_journal_sectors;
+    buffer[PARITY_CNT_INDEX] = metadata.m_parity_cnt;
+    buffer[SECOND_FAILED_DRIVE_INDEX] = metadata.m_second_failed_drive_i;
+    buffer[SPARE_CNT_INDEX] = metadata.m_spare_cnt;
+    buffer[FAILED_SPARES_INDEX] = metadata.m_failed_spares;
+    memcpy(buffer + DRIVE_DEVICES_INDEX, metadata.m_drive_devices, sizeof(metadata.m_drive_devices));
+    buffer[RESHAPE_DEVICES_INDEX] = metadata.m_reshape_devices;
+    buffer[RESHAPE_STRIPE_INDEX] = metadata.m_reshape_stripe;
+    buffer[RESHAPE_BACKUP_STRIPE_INDEX] = metadata.m_reshape_backup_stripe;
+    buffer[VERSION_INDEX] = METADATA_VERSION;
+    buffer[DEVICE_CNT_INDEX] = metadata.m_device_cnt;
+    buffer[SECTOR_CNT_INDEX] = metadata.m_sector_cnt;
+    buffer[LAYOUT_INDEX] = metadata.m_layout;
+    memcpy(buffer + UUID_INDEX, metadata.m_uuid, sizeof(metadata.m_uuid));
+    for (int drive_i = 0; drive_i < MAX_RAID_DEVICES; drive_i++)
+        buffer[DRIVE_ROLES_INDEX + drive_i] = drive_role(metadata, drive_i);
+    buffer[METADATA_CRC_INDEX] = static_cast<int>(crc32c(buffer, SECTOR_SIZE));
+}
+
+bool CRaidVolume::metadata_from_buffer(const INT_SECTOR_BUFFER(buffer), CDriveMetadata &metadata) {
+    if (buffer[MAGIC_INDEX] != METADATA_MAGIC || buffer[VERSION_INDEX] != METADATA_VERSION)
+        return false;
+    // Checksum covers the sector with a zero checksum field
+    INT_SECTOR_BUFFER(crc_buffer);
+    memcpy(crc_buffer, buffer, SECTOR_SIZE);
+    crc_buffer[METADATA_CRC_INDEX] = 0;
+    if (static_cast<int>(crc32c(crc_buffer, SECTOR_SIZE)) != buffer[METADATA_CRC_INDEX])
         return false;
 
-    auto cast_data = static_cast<const int *>(data);
+    metadata.m_failed_drive_i = buffer[FAILED_DRIVE_INDEX];
+    metadata.m_timestamp = buffer[TIMESTAMP_INDEX];
+    metadata.m_degraded_timestamp = buffer[DEGRADED_TIMESTAMP_INDEX];
+    metadata.m_chunk_sectors = buffer[CHUNK_SECTORS_INDEX];
+    metadata.m_journal_sectors = buffer[JOURNAL_SECTORS_INDEX];
+    metadata.m_parity_cnt = buffer[PARITY_CNT_INDEX];
+    metadata.m_second_failed_drive_i = buffer[SECOND_FAILED_DRIVE_INDEX];
+    metadata.m_spare_cnt = buffer[SPARE_CNT_INDEX];
+    metadata.m_failed_spares = buffer[FAILED_SPARES_INDEX];
+    memcpy(metadata.m_drive_devices, buffer + DRIVE_DEVICES_INDEX, sizeof(metadata.m_drive_devices));
+    metadata.m_reshape_devices = buffer[RESHAPE_DEVICES_INDEX];
+    metadata.m_reshape_stripe = buffer[RESHAPE_STRIPE_INDEX];
+    metadata.m_reshape_backup_stripe = buffer[RESHAPE_BACKUP_STRIPE_INDEX];
+    metadata.m_device_cnt = buffer[DEVICE_CNT_INDEX];
+    metadata.m_sector_cnt = buffer[SECTOR_CNT_INDEX];
+    metadata.m_layout = buffer[LAYOUT_INDEX];
+    memcpy(metadata.m_uuid, buffer + UUID_INDEX, sizeof(metadata.m_uuid));
 
-    for (int raid_i = secNr; raid_i < (secNr + secCnt); raid_i++) {
-        // Writing past existing raid sectors
-        if (raid_i >= m_raid_size)
+    // Stored roles have to agree with the failed drives & spares they are derived from
+    for (int drive_i = 0; drive_i < MAX_RAID_DEVICES; drive_i++)
+        if (buffer[DRIVE_ROLES_INDEX + drive_i] != drive_role(metadata, drive_i))
             return false;
+    return true;
+}
 
-        // Translate raid index to "physical" drive/sector/parity_drive indices
-        int drive_i = 0;
-        int sector_i = 0;
-        int parity_drive_i = 0;
-        raid_sector_to_physical(raid_i, drive_i, sector_i, parity_drive_i);
-
-        // Try write data to "FAIL" drive -> only change stripe parity so the "newly
-        // written" dead sector data can be recalculated from new parity + other good sectors
-        if (m_status == RAID_DEGRADED && m_metadata.m_failed_drive_i == drive_i) {
-            // Calculate new parity sector of another "OK" drive
-            INT_SECTOR_BUFFER(new_parity_buffer) = {};
-
-            if (xor_get_parity_supplement_dead_sector(new_parity_buffer, parity_drive_i, drive_i, cast_data, sector_i) >= 0) {
-                // Calculating new parity failed, 2+ drives failed, raid failed
-                m_status = RAID_FAILED;
-                return false;
-            }
-
-            // Write newly calculated parity to "OK" drive
-            if (m_dev->m_Write(parity_drive_i, sector_i, new_parity_buffer, 1) != 1) {
-                // Writing parity failed, 2+ drives failed, raid failed
-                m_status = RAID_FAILED;
-                return false;
-            }
-        }
-
-        // Try write data to "OK" drive in degraded state -> before writing the new data, recalculate
-        else if (m_status == RAID_DEGRADED && m_metadata.m_failed_drive_i != drive_i) {
-            // Parity is on dead drive, just write data
-            if (m_metadata.m_failed_drive_i == parity_drive_i) {
-                if (m_dev->m_Write(drive_i, sector_i, cast_data, 1) != 1) {
-                    // Current drive failed in addition to other degraded drive
-                    m_status = RAID_FAILED;
-                    return false;
-                }
-            }
-            // Parity is among "OK" drives, get original data before calculating new parity
-            else {
-                // Calculate data on dead drive before changing parity
-                INT_SECTOR_BUFFER(dead_drive_data) = {};
-                if (xor_read_without_sector(dead_drive_data, m_metadata.m_failed_drive_i, sector_i) >= 0) {
-                    m_status = RAID_FAILED;
-                    return false;
-                }
-
-                // Write new data to OK sector
-                if (m_dev->m_Write(drive_i, sector_i, cast_data, 1) != 1) {
-                    // Current drive failed in addition to other degraded drive
-                    m_status = RAID_FAILED;
-                    return false;
-                }
-
-                // Calculate new parity sector of another "OK" drive
-                INT_SECTOR_BUFFER(new_parity_buffer) = {};
-                if (xor_get_parity_supplement_dead_sector(new_parity_buffer, parity_drive_i,
-                                                          m_metadata.m_failed_drive_i, dead_drive_data,
-                                                          sector_i) >= 0) {
-                    // Calculating new parity failed, 2+ drives failed, raid failed
-                    m_status = RAID_FAILED;
-                    return false;
-                }
-
-                // Write newly calculated parity to "OK" drive
-                if (m_dev->m_Write(parity_drive_i, sector_i, new_parity_buffer, 1) != 1) {
-                    // Writing parity failed, 2+ drives failed, raid failed
-                    m_status = RAID_FAILED;
-                    return false;
-                }
-            }
-        }
+int CRaidVolume::drive_role(const CDriveMetadata &metadata, const int drive_i) {
+    if (drive_i >= metadata.m_device_cnt)
+        return DRIVE_ROLE_NONE;
+    if (drive_i >= metadata.m_device_cnt - metadata.m_spare_cnt)
+        return metadata.m_failed_spares & (1 << drive_i) ? DRIVE_ROLE_FAULTY_SPARE : DRIVE_ROLE_SPARE;
+    if (drive_i == metadata.m_failed_drive_i || drive_i == metadata.m_second_failed_drive_i)
+        return DRIVE_ROLE_FAILED;
+    return DRIVE_ROLE_ACTIVE;
+}
 
-        // RAID must be RAID_OK, write new data and then write new parity
-        else if (m_status == RAID_OK) {
-            if (m_dev->m_Write(drive_i, sector_i, cast_data, 1) != 1) {
-                // Data drive failed, set raid to degraded state
-                m_status = RAID_DEGRADED;
-                m_metadata.m_failed_drive_i = drive_i;
-                // Repeat write in degraded state
-                raid_i--;
-                continue;
-            }
+void CRaidVolume::read_superblocks(CDriveMetadata metadata[MAX_RAID_DEVICES], bool valid[MAX_RAID_DEVICES]) {
+    int buffers[MAX_RAID_DEVICES][SECTOR_SIZE / sizeof(int)];
+    CDriveIo ios[MAX_RAID_DEVICES];
+    int io_cnt = m_dev->m_Devices;
+    for (int dev_i = 0; dev_i < io_cnt; dev_i++) {
+        ios[dev_i].m_drive_i = dev_i;
+        ios[dev_i].m_sector_i = m_metadata_sector;
+        ios[dev_i].m_sector_cnt = 1;
+        ios[dev_i].m_read_buffer = buffers[dev_i];
+        valid[dev_i] = true;
+    }
 
-            // Recalculate parity sector
-            INT_SECTOR_BUFFER(new_parity_buffer) = {};
-            int failed_drive = -1;
+    // Batch only reports its first failed read, it is repeated without the failed drive
+    int failed_drive = -1;
+    while ((failed_drive = m_io_engine.execute(ios, io_cnt)) >= 0) {
+        valid[failed_drive] = false;
+        for (int io_i = 0; io_i < io_cnt; io_i++)
+            if (ios[io_i].m_drive_i == failed_drive)
+                ios[io_i] = ios[--io_cnt];
+    }
 
-            if ((failed_drive = xor_read_without_sector(new_parity_buffer, parity_drive_i, sector_i)) >= 0) {
-                // Data drive failed, set raid to degraded state
-                m_status = RAID_DEGRADED;
-                m_metadata.m_failed_drive_i = failed_drive;
-                // Repeat write in degraded state
-                raid_i--;
-                continue;
-            }
+    for (int dev_i = 0; dev_i < m_dev->m_Devices; dev_i++)
+        valid[dev_i] = valid[dev_i] && metadata_from_buffer(buffers[dev_i], metadata[dev_i]);
+}
 
-            // Write recalculated parity sector
-            if (m_dev->m_Write(parity_drive_i, sector_i, new_parity_buffer, 1) != 1) {
-                // Parity drive failed, set raid to degraded state
-                m_status = RAID_DEGRADED;
-                m_metadata.m_failed_drive_i = parity_drive_i;
-                // Repeat write in degraded state
-                raid_i--;
+int CRaidVolume::assembly_superblock(const CDriveMetadata *metadata, const bool *valid, const int device_cnt) {
+    int picked_i = -1;
+    int picked_uuid_cnt = 0;
+    int picked_generation_cnt = 0;
+    for (int dev_i = 0; dev_i < device_cnt; dev_i++) {
+        if (!valid[dev_i])
+            continue;
+        int uuid_cnt = 0;
+        int generation_cnt = 0;
+        for (int other_i = 0; other_i < device_cnt; other_i++) {
+            if (!valid[other_i] || memcmp(metadata[dev_i].m_uuid, metadata[other_i].m_uuid, sizeof(metadata->m_uuid)))
                 continue;
-            }
+            uuid_cnt++;
+            if (metadata[other_i].m_timestamp == metadata[dev_i].m_timestamp)
+                generation_cnt++;
         }
+        if (picked_i >= 0
+            && (uuid_cnt < picked_uuid_cnt
+                || (uuid_cnt == picked_uuid_cnt
+                    && (generation_cnt < picked_generation_cnt
+                        || (generation_cnt == picked_generation_cnt
+                            && metadata[dev_i].m_timestamp <= metadata[picked_i].m_timestamp)))))
+            continue;
+        picked_i = dev_i;
+        picked_uuid_cnt = uuid_cnt;
+        picked_generation_cnt = generation_cnt;
+    }
+    if (picked_i < 0)
+        return picked_i;
 
-        // Increment buffer pointer
-        cast_data += (SECTOR_SIZE / sizeof(int));
+    // Majority generation may miss a failure recorded by an interrupted metadata update, data of the failed drive
+    // is outdated then, only the newest superblock is trusted
+    int newest_i = picked_i;
+    bool newer_failures = false;
+    for (int dev_i = 0; dev_i < device_cnt; dev_i++) {
+        if (!valid[dev_i] || metadata[dev_i].m_timestamp <= metadata[picked_i].m_timestamp
+            || memcmp(metadata[dev_i].m_uuid, metadata[picked_i].m_uuid, sizeof(metadata->m_uuid)))
+            continue;
+        newer_failures = newer_failures || !same_drive_state(metadata[dev_i], metadata[picked_i]);
+        if (metadata[dev_i].m_timestamp > metadata[newest_i].m_timestamp)
+            newest_i = dev_i;
     }
+    return newer_failures ? newest_i : picked_i;
+}
 
+bool CRaidVolume::same_drive_state(const CDriveMetadata &first, const CDriveMetadata &second) {
+    if (first.m_device_cnt != second.m_device_cnt || first.m_spare_cnt != second.m_spare_cnt
+        || first.m_failed_drive_i != second.m_failed_drive_i
+        || first.m_second_failed_drive_i != second.m_second_failed_drive_i
+        || first.m_failed_spares != second.m_failed_spares)
+        return false;
+    for (int drive_i = 0; drive_i < first.m_device_cnt && drive_i < MAX_RAID_DEVICES; drive_i++)
+        if (first.m_drive_devices[drive_i] != second.m_drive_devices[drive_i])
+            return false;
     return true;
 }
 
-bool CRaidVolume::validate_t_blk_dev(const TBlkDev &dev) {
-    if (dev.m_Devices < 3 || dev.m_Devices > MAX_RAID_DEVICES)
-        return false;
-    if (dev.m_Sectors < MIN_DEVICE_SECTORS || dev.m_Sectors > MAX_DEVICE_SECTORS)
-        return false;
-    if (!dev.m_Read)
-        return false;
-    if (!dev.m_Write)
+bool CRaidVolume::reshape_begun(const CDriveMetadata &before, const CDriveMetadata &after) {
+    // Added drives take the drive indices following the member drives, hot spares move past them
+    const int device_cnt = before.m_device_cnt;
+    const int member_cnt = device_cnt - before.m_spare_cnt;
+    const int added_cnt = after.m_device_cnt - device_cnt;
+    if (before.m_reshape_devices != 0 || after.m_reshape_devices != member_cnt || after.m_reshape_stripe != 0
+        || after.m_reshape_backup_stripe >= 0 || added_cnt < 1 || after.m_spare_cnt != before.m_spare_cnt
+        || after.m_failed_drive_i != before.m_failed_drive_i
+        || after.m_second_failed_drive_i != before.m_second_failed_drive_i
+        || after.m_failed_spares != before.m_failed_spares << added_cnt)
         return false;
+    for (int drive_i = 0; drive_i < member_cnt && drive_i < MAX_RAID_DEVICES; drive_i++)
+        if (after.m_drive_devices[drive_i] != before.m_drive_devices[drive_i])
+            return false;
+    for (int spare_i = member_cnt; spare_i < device_cnt && spare_i + added_cnt < MAX_RAID_DEVICES; spare_i++)
+        if (after.m_drive_devices[spare_i + added_cnt] != before.m_drive_devices[spare_i])
+            return false;
     return true;
 }
 
-void CRaidVolume::raid_sector_to_physical(const int raid_sector, int &drive_i, int &drive_sector_i,
-                                          int &parity_drive_i) const {
-    const int mod = m_dev->m_Devices;
-
-    const int skipped_parities = 1 + (int) (raid_sector / mod) + (raid_sector/(mod * (mod-1)));
-    const int phys_sector = raid_sector + skipped_parities;
-
-    drive_i = phys_sector % mod;
-    drive_sector_i = phys_sector / mod;
-    parity_drive_i = (phys_sector / mod) % mod;
+void CRaidVolume::resync_cancel() {
+    {
+        lock_guard<mutex> resync_lock(m_resync_mutex);
+        m_resync_cancel = true;
+    }
+    if (m_resync_thread.joinable())
+        m_resync_thread.join();
 }
 
 void CRaidVolume::clear_raid_volume_data() {
+    m_request_executor.stop();
+    m_io_engine.stop();
+
     // Free & reset heap variables
     delete m_dev;
     m_dev = nullptr;
@@ -605,64 +5281,157 @@ void CRaidVolume::clear_raid_volume_data() {
     // Reset stack variables
     m_metadata_sector = 0;
     m_metadata = {};
+    m_row_cnt = 0;
+    m_geometry = {};
+    m_reshape_geometry = {};
+    m_reshape_stripe = 0;
+    m_reshape_sector = 0;
+    m_bitmap_sector = 0;
+    m_bitmap_region_rows = 1;
     m_status = RAID_STOPPED;
+    m_failed_drive_i = -1;
+    m_second_failed_drive_i = -1;
+    m_row_cache.clear();
+    m_write_cache.configure(0, 1);
+    m_write_back_stripes = 0;
+    m_journal_first_sector = 0;
+    m_journal_sectors = 0;
+    m_journal_active = false;
+    m_journal_queue.clear();
+    m_journal_txns.clear();
+    m_journal_committing = false;
+    m_journal_seq = 0;
+    m_journal_head = 0;
     m_raid_size = 0;
+    m_resync_watermark = 0;
+    m_spare_rebuild_pending = false;
+    m_spare_rebuild_drives = 0;
 }
 
-inline void CRaidVolume::xor_int_buffers(INT_SECTOR_BUFFER(out_buffer), const INT_SECTOR_BUFFER(in_buffer)) {
-    for (int i = 0; i < static_cast<int>(SECTOR_SIZE / sizeof(int)); i++) {
-        out_buffer[i] = out_buffer[i] ^ in_buffer[i];
+int CRaidVolume::reconstruct_sector(INT_SECTOR_BUFFER(out_buffer), const int drive_i, const int sector_i) const {
+    // Drive was rebuilt or replaced meanwhile
+    if (!drive_failed_at(drive_i, sector_i))
+        return m_io_engine.read(drive_i, sector_i, out_buffer, 1) ? -1 : drive_i;
+    const CRaidGeometry &geometry = row_geometry(sector_i);
+    if (geometry.m_parity_cnt == 1)
+        return xor_read_without_sector(out_buffer, drive_i, sector_i);
+
+    // Row blocks in stripe order (data chunks, P, Q), blocks of failed drives are reconstructed into scratch sectors
+    int drives[MAX_RAID_DEVICES];
+    geometry.stripe_drives_of(sector_i, drives);
+    INT_SECTOR_BUFFER(row_buffer[MAX_RAID_DEVICES]);
+    void *blocks[MAX_RAID_DEVICES];
+    CDriveIo row_ios[MAX_RAID_DEVICES];
+    int row_io_cnt = 0;
+    int lost[2] = {-1, -1};
+    int lost_cnt = 0;
+    int wanted_block = -1;
+
+    for (int block_i = 0; block_i < geometry.m_devices; block_i++) {
+        blocks[block_i] = row_buffer[block_i];
+        if (drives[block_i] == drive_i)
+            wanted_block = block_i;
+        if (drive_failed_at(drives[block_i], sector_i)) {
+            lost[lost_cnt++] = block_i;
+            continue;
+        }
+        row_ios[row_io_cnt].m_drive_i = drives[block_i];
+        row_ios[row_io_cnt].m_sector_i = sector_i;
+        row_ios[row_io_cnt].m_sector_cnt = 1;
+        row_ios[row_io_cnt].m_read_buffer = row_buffer[block_i];
+        row_io_cnt++;
     }
+
+    int failed_drive = -1;
+    if ((failed_drive = m_io_engine.execute(row_ios, row_io_cnt)) >= 0)
+        return failed_drive;
+
+    // Failed drives may have been rebuilt meanwhile, then all blocks were read
+    if (lost_cnt > 0)
+        CGfKernel::recover(blocks, geometry.data_drive_cnt(), lost[0], lost[1], SECTOR_SIZE);
+    memcpy(out_buffer, row_buffer[wanted_block], SECTOR_SIZE);
+    return -1;
 }
 
 inline int CRaidVolume::xor_read_without_sector(
     INT_SECTOR_BUFFER(out_buffer), const int dead_drive_i, const int sector_i) const {
-    // Create next buffer for newly read sectors
-    INT_SECTOR_BUFFER(next_buffer);
-
-    // Clear read and next buffer
-    memset(out_buffer, 0, SECTOR_SIZE);
-    memset(next_buffer, 0, SECTOR_SIZE);
+    // Row buffer for sectors of all other drives, read in parallel
+    INT_SECTOR_BUFFER(row_buffer[MAX_RAID_DEVICES]);
+    const void *row_sectors[MAX_RAID_DEVICES];
+    CDriveIo row_ios[MAX_RAID_DEVICES];
+    int row_sector_cnt = 0;
+    const int drive_cnt = row_geometry(sector_i).m_devices;
 
-    for (int drive_i = 0; drive_i < m_dev->m_Devices; drive_i++) {
+    for (int drive_i = 0; drive_i < drive_cnt; drive_i++) {
         if (drive_i == dead_drive_i)
             continue;
-        if (m_dev->m_Read(drive_i, sector_i, next_buffer, 1) != 1)
-            return drive_i;
-        xor_int_buffers(out_buffer, next_buffer);
+        row_ios[row_sector_cnt].m_drive_i = drive_i;
+        row_ios[row_sector_cnt].m_sector_i = sector_i;
+        row_ios[row_sector_cnt].m_sector_cnt = 1;
+        row_ios[row_sector_cnt].m_read_buffer = row_buffer[row_sector_cnt];
+        row_sectors[row_sector_cnt] = row_buffer[row_sector_cnt];
+        row_sector_cnt++;
     }
+
+    int failed_drive = -1;
+    if ((failed_drive = m_io_engine.execute(row_ios, row_sector_cnt)) >= 0)
+        return failed_drive;
+
+    // Xor all read sectors in a single pass
+    memset(out_buffer, 0, SECTOR_SIZE);
+    CXorKernel::xor_blocks(out_buffer, row_sectors, row_sector_cnt, SECTOR_SIZE);
     return -1;
 }
 
 inline int CRaidVolume::xor_get_parity_supplement_dead_sector(
     INT_SECTOR_BUFFER(out_buffer), const int parity_drive_i, const int dead_drive_i,
     const INT_SECTOR_BUFFER(dead_drive_supplement_buffer), const int sector_i) const {
-    // Create next buffer for newly read sectors
-    INT_SECTOR_BUFFER(next_buffer);
-
-    // Clear read and next buffer
-    memset(out_buffer, 0, SECTOR_SIZE);
-    memset(next_buffer, 0, SECTOR_SIZE);
+    // Row buffer for sectors of all other drives, read in parallel
+    INT_SECTOR_BUFFER(row_buffer[MAX_RAID_DEVICES]);
+    const void *row_sectors[MAX_RAID_DEVICES];
+    CDriveIo row_ios[MAX_RAID_DEVICES];
+    int row_sector_cnt = 0;
+    int row_io_cnt = 0;
+    const int drive_cnt = row_geometry(sector_i).m_devices;
 
-    for (int drive_i = 0; drive_i < m_dev->m_Devices; drive_i++) {
+    for (int drive_i = 0; drive_i < drive_cnt; drive_i++) {
         if (drive_i == parity_drive_i)
             continue;
-        // Supplement dead drive data by provided buffer & xor
+        // Supplement dead drive data by provided buffer
         if (drive_i == dead_drive_i) {
-            xor_int_buffers(out_buffer, dead_drive_supplement_buffer);
+            row_sectors[row_sector_cnt++] = dead_drive_supplement_buffer;
             continue;
         }
-        // Xor out buffer with newly read next buffer
-        if (m_dev->m_Read(drive_i, sector_i, next_buffer, 1) != 1)
-            return drive_i;
-        xor_int_buffers(out_buffer, next_buffer);
+        row_ios[row_io_cnt].m_drive_i = drive_i;
+        row_ios[row_io_cnt].m_sector_i = sector_i;
+        row_ios[row_io_cnt].m_sector_cnt = 1;
+        row_ios[row_io_cnt].m_read_buffer = row_buffer[row_sector_cnt];
+        row_io_cnt++;
+        row_sectors[row_sector_cnt] = row_buffer[row_sector_cnt];
+        row_sector_cnt++;
     }
+
+    int failed_drive = -1;
+    if ((failed_drive = m_io_engine.execute(row_ios, row_io_cnt)) >= 0)
+        return failed_drive;
+
+    // Xor all sectors in a single pass
+    memset(out_buffer, 0, SECTOR_SIZE);
+    CXorKernel::xor_blocks(out_buffer, row_sectors, row_sector_cnt, SECTOR_SIZE);
     return -1;
 }
 
 
 #ifndef __PROGTEST__
 
+#include "file_blkdev.inc"
+
+#ifdef RAID_BENCHMARK
+#include "benchmark.inc"
+#elif defined(RAID_REGRESSION)
+#include "regression.inc"
+#else
 #include "custom.inc"
+#endif
 
 #endif /* __PROGTEST__ */
\ No newline at end of file